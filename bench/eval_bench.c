@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "parser.h"
+#include "eval.h"
+#include "ccomp.h"
+#include "interp.h"
+
+/*
+ * Compares tree walker with closure compiled tree on deep and wide expressions.
+ * Every case has inputs, so it's not folded into constant while compiling.
+ */
+
+#define BENCH_DEPTH 256
+#define BENCH_WIDTH 4096
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    char *items;
+} Buffer;
+
+__attribute__((format(printf, 2, 3)))
+static void buf_printf(Buffer *b, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    if (b->count + n + 1 > b->capacity) {
+        b->capacity = (b->count + n + 1) * 2;
+        b->items = realloc(b->items, b->capacity);
+    }
+
+    va_start(args, fmt);
+    vsnprintf(b->items + b->count, n + 1, fmt, args);
+    va_end(args);
+    b->count += n;
+}
+
+// (op leaf (op leaf ... (op leaf bottom)))
+static String_View gen_deep(const char *ops, const char *leaf, const char *bottom, size_t depth)
+{
+    Buffer b = {0};
+    size_t nops = strlen(ops);
+    for (size_t i = 0; i < depth; ++i) buf_printf(&b, "(%c %s ", ops[i % nops], leaf);
+    buf_printf(&b, "%s", bottom);
+    for (size_t i = 0; i < depth; ++i) buf_printf(&b, ")");
+    return sv_from_parts(b.items, b.count);
+}
+
+// (op first $0 $1 $0 $1 ...)
+static String_View gen_wide(char op, const char *first, size_t width)
+{
+    Buffer b = {0};
+    buf_printf(&b, "(%c %s", op, first);
+    for (size_t i = 0; i < width; ++i) buf_printf(&b, " $%zu", i & 1);
+    buf_printf(&b, ")");
+    return sv_from_parts(b.items, b.count);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    const char *name;
+    String_View src;
+    size_t iters;
+} Bench_Case;
+
+static int bench_case(Interp *I, Arena *a, Bench_Case *bc, Inputs in)
+{
+    Lexer L = lexer_new(NULL, bc->src);
+    Statement s = parse_statement(I, a, &L);
+    if (s.t == STATEMENT_ERROR) {
+        error_dump(s.v.err);
+        report("Cannot parse case `%s`", bc->name);
+        return 0;
+    }
+
+    CNode *n = ccomp_statement(I, a, &s);
+    LObject walked = eval(I, a, &s, in);
+    LObject compiled = ccomp_run(I, a, n, in);
+    if (walked != compiled) {
+        report("Results of `%s` are different", bc->name);
+        return 0;
+    }
+
+    double start = now();
+    for (size_t i = 0; i < bc->iters; ++i) walked = eval(I, a, &s, in);
+    double walk = (now() - start) / bc->iters * 1e9;
+
+    start = now();
+    for (size_t i = 0; i < bc->iters; ++i) compiled = ccomp_run(I, a, n, in);
+    double cc = (now() - start) / bc->iters * 1e9;
+
+    printf("%-14s %12.1lf %12.1lf %8.2lfx\n", bc->name, walk, cc, walk / cc);
+    return walked == compiled;
+}
+
+int main(void)
+{
+    Interp I = {0};
+    Arena a = {0};
+    LObject items[2] = { obj_int(&a, 3), obj_int(&a, 2) };
+    Inputs in = { .count = 2, .items = items };
+
+    Bench_Case cases[] = {
+        { "deep-dyn",   gen_deep("+-", "$0", "$1", BENCH_DEPTH),  20000 },
+        { "deep-typed", gen_deep("+*", "1", "$0", BENCH_DEPTH),   20000 },
+        { "deep-mixed", gen_deep("+-", "1.5", "$0", BENCH_DEPTH), 20000 },
+        { "wide-dyn",   gen_wide('+', "$0", BENCH_WIDTH),   5000 },
+        { "wide-typed", gen_wide('*', "1.0", BENCH_WIDTH),  5000 },
+    };
+
+    printf("%-14s %12s %12s %9s\n", "case", "walker ns", "ccomp ns", "speedup");
+    int status = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        if (!bench_case(&I, &a, &cases[i], in)) status = 1;
+        free(cases[i].src.data);
+    }
+
+    arena_free(&a);
+    interp_free(&I);
+    return status;
+}
@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "lexer.h"
+#include "parser.h"
+#include "eval.h"
+#include "interp.h"
+
+/*
+ * Measures lexer, parser and evaluator separately on generated sources.
+ * Every phase runs over whole source several times and best run is reported.
+ * Parser keeps every tree of source, evaluator runs them and drops everything
+ * except results, so bytes of evaluation are memory left after it.
+ * With `-DARENA_STATS` high water of arena is reported as well, for evaluation
+ * it's counted above trees.
+ */
+
+#define PHASE_RUNS    3
+#define PHASE_SIZE_MB 2  // Size of every workload, `big` is 4 times bigger
+#define DEEP_DEPTH    512
+#define WIDE_WIDTH    4096
+#define STRING_LENGTH 4096
+#define COMMENT_LINES 16
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    char *items;
+} Buffer;
+
+__attribute__((format(printf, 2, 3)))
+static void buf_printf(Buffer *b, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    if (b->count + n + 1 > b->capacity) {
+        b->capacity = (b->count + n + 1) * 2;
+        b->items = realloc(b->items, b->capacity);
+    }
+
+    va_start(args, fmt);
+    vsnprintf(b->items + b->count, n + 1, fmt, args);
+    va_end(args);
+    b->count += n;
+}
+
+/*
+ * Workloads. Every generator appends forms until source reaches `size` bytes
+ */
+
+// (+ 1 (- 2 (+ 3 ... 0)))
+static void gen_deep(Buffer *b, size_t size)
+{
+    while (b->count < size) {
+        for (size_t i = 0; i < DEEP_DEPTH; ++i) buf_printf(b, "(%c %zu ", i & 1 ? '-' : '+', i);
+        buf_printf(b, "0");
+        for (size_t i = 0; i < DEEP_DEPTH; ++i) buf_printf(b, ")");
+        buf_printf(b, "\n");
+    }
+}
+
+// (+ 0 1 2 ... 4095)
+static void gen_wide(Buffer *b, size_t size)
+{
+    while (b->count < size) {
+        buf_printf(b, "(+");
+        for (size_t i = 0; i < WIDE_WIDTH; ++i) buf_printf(b, " %zu", i);
+        buf_printf(b, ")\n");
+    }
+}
+
+// (let ((s "N-th long string")) s), every string is different so all of them are interned
+static void gen_strings(Buffer *b, size_t size)
+{
+    for (size_t n = 0; b->count < size; ++n) {
+        buf_printf(b, "(let ((s \"%zu ", n);
+        for (size_t i = 0; i < STRING_LENGTH; ++i) buf_printf(b, "%c", 'a' + (char)(i % 26));
+        buf_printf(b, "\")) s)\n");
+    }
+}
+
+// Small forms between blocks of comments
+static void gen_comments(Buffer *b, size_t size)
+{
+    for (size_t n = 0; b->count < size; ++n) {
+        for (size_t i = 0; i < COMMENT_LINES; ++i)
+            buf_printf(b, "; comment line %zu of block %zu, (parens) and \"quotes\" are ignored here\n", i, n);
+        buf_printf(b, "(* %zu 2)\n", n);
+    }
+}
+
+// Definitions and calls of small functions, like real program
+static void gen_program(Buffer *b, size_t size)
+{
+    for (size_t n = 0; b->count < size; ++n) {
+        buf_printf(b, "(define f%zu (lambda (x y) (let ((s (+ x y)) (d (- x y))) (if (< s d) (* s 2) (/ d 2.0)))))\n", n);
+        buf_printf(b, "(f%zu %zu 3)\n", n, n);
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*gen)(Buffer *b, size_t size);
+    size_t scale;
+} Workload;
+
+/*
+ * Phases
+ */
+
+typedef enum {
+    PHASE_LEX = 0,
+    PHASE_PARSE,
+    PHASE_EVAL,
+    PHASE_COUNT,
+} Phase;
+
+static const char *phase_names[PHASE_COUNT] = { "lex", "parse", "eval" };
+static const char *unit_names[PHASE_COUNT] = { "tokens", "nodes", "nodes" };
+
+typedef struct {
+    double secs;      // Best run
+    size_t ops;       // Tokens for lexer, nodes of trees otherwise
+    size_t bytes;     // Bytes of arena left after run
+    size_t high;      // High water of arena, only with ARENA_STATS
+} Phase_Result;
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    Statement *items;
+} Statements;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t arena_high(Arena *a)
+{
+#ifdef ARENA_STATS
+    return a->stats.high_water;
+#else
+    (void)a;
+    return 0;
+#endif
+}
+
+static void phase_lex(String_View src, Phase_Result *r)
+{
+    for (size_t run = 0; run < PHASE_RUNS; ++run) {
+        Lexer L = lexer_new(NULL, src);
+        double start = now();
+        while (lexer_next(&L).type != TK_NONE);
+        double secs = now() - start;
+
+        if (!run || secs < r->secs) r->secs = secs;
+        r->ops = L.ntokens;
+    }
+}
+
+// Trees of last run are kept in arena for evaluation
+static int phase_parse(Interp *I, Arena *a, String_View src, Statements *out, Phase_Result *r)
+{
+    Arena_Mark mark = arena_mark(a);
+
+    for (size_t run = 0; run < PHASE_RUNS; ++run) {
+        arena_rewind(a, mark);
+        out->count = 0;
+
+        Lexer L = lexer_new(NULL, src);
+        double start = now();
+        while (lexer_peek(&L).type != TK_NONE) {
+            Statement s = parse_statement(I, a, &L);
+            if (s.t == STATEMENT_ERROR) {
+                error_dump(s.v.err);
+                return 0;
+            }
+            if (out->count == out->capacity) {
+                out->capacity = out->capacity ? out->capacity * 2 : 256;
+                out->items = realloc(out->items, sizeof(Statement) * out->capacity);
+            }
+            out->items[out->count++] = s;
+        }
+        double secs = now() - start;
+
+        if (!run || secs < r->secs) r->secs = secs;
+    }
+
+    r->ops = 0;
+    for (size_t i = 0; i < out->count; ++i) r->ops += expr_count(&out->items[i].v.e);
+    r->bytes = arena_used(a);
+    r->high = arena_high(a);
+    return 1;
+}
+
+static int phase_eval(Interp *I, Arena *a, Statements *ss, size_t nodes, Phase_Result *r)
+{
+    size_t before = arena_used(a);
+    Arena_Mark mark = arena_mark(a);
+
+    for (size_t run = 0; run < PHASE_RUNS; ++run) {
+        arena_rewind(a, mark);
+        double start = now();
+        for (size_t i = 0; i < ss->count; ++i) {
+            if (obj_is_none(stateval(I, a, &ss->items[i]))) {
+                report("Evaluation of form %zu failed", i);
+                return 0;
+            }
+        }
+        double secs = now() - start;
+
+        if (!run || secs < r->secs) r->secs = secs;
+    }
+
+    r->ops = nodes;
+    r->bytes = arena_used(a) - before;
+    r->high = arena_high(a) - before;
+    return 1;
+}
+
+/*
+ * Reports
+ */
+
+static void report_text_header(void)
+{
+    printf("%-10s %-6s %10s %9s %14s %10s %12s\n", "workload", "phase", "bytes in", "MB/s", "ops/s", "ns/op", "arena bytes");
+}
+
+static void report_text(const char *workload, Phase p, size_t input, Phase_Result *r)
+{
+    char ops[32];
+    snprintf(ops, sizeof(ops), "%.2lfM %s", r->ops / r->secs / 1e6, unit_names[p]);
+
+    printf("%-10s %-6s %10zu %9.1lf %14s %10.2lf %12zu",
+           workload, phase_names[p], input, input / r->secs / (1024.0 * 1024.0),
+           ops, r->secs / r->ops * 1e9, r->bytes);
+#ifdef ARENA_STATS
+    printf(" (high water %zu)", r->high);
+#endif
+    printf("\n");
+}
+
+static void report_json(const char *workload, Phase p, size_t input, Phase_Result *r, int first)
+{
+    printf("%s\n  {\"workload\": \"%s\", \"phase\": \"%s\", \"bytes_in\": %zu, \"secs\": %.9lf, "
+           "\"mb_per_sec\": %.3lf, \"%s_per_sec\": %.1lf, \"ns_per_op\": %.3lf, \"arena_bytes\": %zu",
+           first ? "" : ",", workload, phase_names[p], input, r->secs,
+           input / r->secs / (1024.0 * 1024.0), unit_names[p], r->ops / r->secs,
+           r->secs / r->ops * 1e9, r->bytes);
+#ifdef ARENA_STATS
+    printf(", \"high_water\": %zu", r->high);
+#endif
+    printf("}");
+}
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [--json] [--size=MB]\n", program);
+    printf("    --json       prints results as JSON array\n");
+    printf("    --size=MB    size of every workload, %d by default\n", PHASE_SIZE_MB);
+}
+
+int main(int argc, char **argv)
+{
+    int json = 0;
+    size_t size = PHASE_SIZE_MB;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--json")) json = 1;
+        else if (!strncmp(argv[i], "--size=", 7) && atoi(argv[i] + 7) > 0) size = atoi(argv[i] + 7);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    Workload workloads[] = {
+        { "deep",     gen_deep,     1 },
+        { "wide",     gen_wide,     1 },
+        { "strings",  gen_strings,  1 },
+        { "comments", gen_comments, 1 },
+        { "big",      gen_program,  4 },
+    };
+
+    if (json) printf("[");
+    else report_text_header();
+
+    int status = 0, first = 1;
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); ++w) {
+        Workload *wl = &workloads[w];
+        Buffer b = {0};
+        wl->gen(&b, size * wl->scale * 1024 * 1024);
+        String_View src = sv_from_parts(b.items, b.count);
+
+        // Every workload gets fresh interpreter and arena, so results don't depend on order
+        Interp I = {0};
+        Arena a = {0};
+        Statements ss = {0};
+        Phase_Result r[PHASE_COUNT] = {0};
+
+        phase_lex(src, &r[PHASE_LEX]);
+        int ok = phase_parse(&I, &a, src, &ss, &r[PHASE_PARSE]) &&
+                 phase_eval(&I, &a, &ss, r[PHASE_PARSE].ops, &r[PHASE_EVAL]);
+
+        if (!ok) {
+            report("Workload `%s` failed", wl->name);
+            status = 1;
+        } else {
+            for (Phase p = 0; p < PHASE_COUNT; ++p) {
+                if (json) report_json(wl->name, p, src.count, &r[p], first);
+                else report_text(wl->name, p, src.count, &r[p]);
+                first = 0;
+            }
+        }
+
+        free(ss.items);
+        arena_free(&a);
+        interp_free(&I);
+        free(b.items);
+    }
+
+    if (json) printf("\n]\n");
+    return status;
+}
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+/*
+ * Load generator for `lambda --serve PATH`.
+ * Every connection runs in own thread and sends requests one after another,
+ * latency of request is time from sending frame until whole response is read.
+ * Only requests answered without error are completed, statistics are taken over them.
+ */
+
+#define LOAD_CONNS    4
+#define LOAD_REQUESTS 10000
+#define LOAD_SOURCE   "(* (+ 1 2 3 4) (- 10 2.5))"
+
+typedef struct {
+    pthread_t thread;
+    const char *path;
+    const char *src;
+    size_t requests;
+    double *latency; // Seconds of every completed request
+    size_t completed;
+    size_t failed;
+} Load_Conn;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int load_connect(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *load_run(void *arg)
+{
+    Load_Conn *c = arg;
+    int fd = load_connect(c->path);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot connect to `%s`\n", c->path);
+        c->failed = c->requests;
+        return NULL;
+    }
+
+    char *buf = NULL;
+    size_t capacity = 0;
+    u32 n;
+    size_t len = strlen(c->src);
+
+    for (size_t i = 0; i < c->requests; ++i) {
+        double start = now();
+        if (!frame_write(fd, c->src, len) || !frame_read(fd, &buf, &capacity, &n) || n == 0) {
+            fprintf(stderr, "Connection closed after %zu requests\n", i);
+            c->failed += c->requests - i;
+            break;
+        }
+        if (buf[0] != SERVE_OK) c->failed += 1;
+        else c->latency[c->completed++] = now() - start;
+    }
+
+    free(buf);
+    close(fd);
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char *program)
+{
+    printf("Usage: %s <socket> [-c connections] [-n requests] [-e source]\n", program);
+    printf("    -c    count of concurrent connections, %d by default\n", LOAD_CONNS);
+    printf("    -n    requests per connection, %d by default\n", LOAD_REQUESTS);
+    printf("    -e    source of every request, `%s` by default\n", LOAD_SOURCE);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    const char *src = LOAD_SOURCE;
+    size_t conns = LOAD_CONNS;
+    size_t requests = LOAD_REQUESTS;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc) conns = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc) requests = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-e") && i + 1 < argc) src = argv[++i];
+        else if (argv[i][0] != '-' && !path) path = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!path || !conns || !requests) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Load_Conn *cs = calloc(conns, sizeof(Load_Conn));
+    double *latency = calloc(conns * requests, sizeof(double));
+
+    double start = now();
+    for (size_t i = 0; i < conns; ++i) {
+        cs[i] = (Load_Conn) { .path = path, .src = src, .requests = requests, .latency = latency + i * requests };
+        pthread_create(&cs[i].thread, NULL, load_run, &cs[i]);
+    }
+
+    // Samples of connections are moved together
+    size_t failed = 0, completed = 0;
+    for (size_t i = 0; i < conns; ++i) {
+        pthread_join(cs[i].thread, NULL);
+        failed += cs[i].failed;
+        memmove(latency + completed, cs[i].latency, sizeof(double) * cs[i].completed);
+        completed += cs[i].completed;
+    }
+    double wall = now() - start;
+
+    printf("%zu requests over %zu connections in %.3lf sec, %zu completed, %zu failed\n",
+           conns * requests, conns, wall, completed, failed);
+    if (completed) {
+        qsort(latency, completed, sizeof(double), cmp_double);
+        printf("p50 %.1lf us, p99 %.1lf us, max %.1lf us\n",
+               latency[completed / 2] * 1e6, latency[completed * 99 / 100] * 1e6, latency[completed - 1] * 1e6);
+    }
+    printf("%.0lf requests/sec\n", completed / wall);
+
+    free(latency);
+    free(cs);
+    return failed ? 1 : 0;
+}
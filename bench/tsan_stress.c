@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "liblambda.h"
+#include "interp.h"
+#include "native.h"
+
+/*
+ * Stress test of independent interpreters, built by `./bin/build tsan`
+ * with ThreadSanitizer. Every thread owns context with its own globals,
+ * natives and pool of futures, and checks that it sees only its own state:
+ * values of globals, natives registered only by some threads and errors.
+ * Exit status is 1 if any thread got unexpected result.
+ */
+
+#define STRESS_THREADS 8
+#define STRESS_ITERS   200
+#define STRESS_FUTURES 2 // Threads of pool of every context, with thread of context
+
+#define FIB_SOURCE "(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))"
+
+typedef struct {
+    pthread_t thread;
+    size_t id;
+    size_t iters;
+    size_t checks;
+    size_t failed;
+} Stress_Thread;
+
+static LObject native_one(Interp *I, Arena *a, LObject *args, size_t count)
+{
+    (void)I; (void)args; (void)count;
+    return obj_int(a, 1);
+}
+
+static void stress_check(Stress_Thread *t, int ok, const char *what)
+{
+    t->checks += 1;
+    if (ok) return;
+    t->failed += 1;
+    fprintf(stderr, "Thread %zu: %s\n", t->id, what);
+}
+
+static int is_int(LObject o, i64 v)
+{
+    return !lam_is_error(o) && lam_type(o) == OBJ_TYPE_INT && lam_as_int(o) == v;
+}
+
+static void *stress_run(void *arg)
+{
+    Stress_Thread *t = arg;
+    Lam_Ctx *ctx = lam_ctx_new();
+    lam_interp(ctx)->threads = STRESS_FUTURES;
+
+    // Only even threads have native, odd ones must not see it
+    if (t->id % 2 == 0) lam_register_native(lam_interp(ctx), "one", native_one, 0, 0);
+
+    char src[128];
+    i64 id = (i64)t->id;
+    snprintf(src, sizeof(src), "(define id %lli)", id);
+
+    for (size_t i = 0; i < t->iters; ++i) {
+        // Globals survive reset, so they are defined again only sometimes
+        if (i % 50 == 0) {
+            lam_ctx_reset(ctx);
+            stress_check(t, is_int(lam_eval_cstr(ctx, src), id), "define of id");
+            stress_check(t, !lam_is_error(lam_eval_cstr(ctx, FIB_SOURCE)), "define of fib");
+        }
+
+        LObject o = lam_eval_cstr(ctx, "(+ id (touch (future (fib 10))) (* id 2))");
+        stress_check(t, is_int(o, 3 * id + 55), "value of future");
+
+        o = lam_eval_cstr(ctx, "(let ((a (future (fib 8))) (b (future (+ id 1)))) (+ (touch a) (touch b)))");
+        stress_check(t, is_int(o, 21 + id + 1), "value of two futures");
+
+        o = lam_eval_cstr(ctx, "(one)");
+        stress_check(t, t->id % 2 == 0 ? is_int(o, 1) : lam_is_error(o), "native of other thread");
+
+        o = lam_eval_cstr(ctx, "(+ 1 (/ id 0))");
+        const Error *err = lam_error(ctx);
+        stress_check(t, lam_is_error(o) && err && err->row == 1 && err->col == 7, "place of division by zero");
+
+        o = lam_eval_cstr(ctx, "(+ 1");
+        stress_check(t, lam_is_error(o) && lam_error(ctx), "error of parser");
+    }
+
+    lam_ctx_free(ctx);
+    return NULL;
+}
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [-t threads] [-n iterations]\n", program);
+    printf("    -t    count of concurrent interpreters, %d by default\n", STRESS_THREADS);
+    printf("    -n    iterations of every interpreter, %d by default\n", STRESS_ITERS);
+}
+
+int main(int argc, char **argv)
+{
+    size_t threads = STRESS_THREADS;
+    size_t iters = STRESS_ITERS;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) threads = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc) iters = strtoul(argv[++i], NULL, 10);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!threads) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Stress_Thread *ts = calloc(threads, sizeof(Stress_Thread));
+    for (size_t i = 0; i < threads; ++i) {
+        ts[i] = (Stress_Thread) { .id = i, .iters = iters };
+        pthread_create(&ts[i].thread, NULL, stress_run, &ts[i]);
+    }
+
+    size_t checks = 0, failed = 0;
+    for (size_t i = 0; i < threads; ++i) {
+        pthread_join(ts[i].thread, NULL);
+        checks += ts[i].checks;
+        failed += ts[i].failed;
+    }
+
+    printf("%zu interpreters, %zu checks, %zu failed\n", threads, checks, failed);
+
+    free(ts);
+    return failed ? 1 : 0;
+}
@@ -3,11 +3,68 @@
 
 #define CC "gcc"
 #define TAR "bin/lambda"
-#define SRC "src/lambda.c", "src/arena.c", "src/lexer.c", "src/sv.c", "src/parser.c", "src/types.c"
+#define LIB_SRC "src/arena.c", "src/lexer.c", "src/sv.c", "src/parser.c", "src/eval.c", "src/arith.c", "src/intern.c", "src/types.c", "src/compiler.c", "src/vm.c", "src/native.c", "src/env.c", "src/ccomp.c", "src/interp.c", "src/future.c", "src/profile.c"
+#define SRC "src/lambda.c", "src/server.c", LIB_SRC
+#define LIB_DIR "bin/obj"
+#define LIB_STATIC "bin/liblambda.a"
+#define LIB_SHARED "bin/liblambda.so"
+#define LIB_CFLAGS "-Wall", "-Wextra", "-O2", "-fPIC"
+#define BENCH_TAR "bin/bench"
+#define BENCH_SRC "bench/eval_bench.c"
+#define PHASE_TAR "bin/phase_bench"
+#define PHASE_SRC "bench/phase_bench.c"
+#define LOAD_TAR "bin/serve_load"
+#define LOAD_SRC "bench/serve_load.c"
+#define TSAN_TAR "bin/tsan_stress"
+#define TSAN_SRC "bench/tsan_stress.c"
+#define TSAN_FLAGS "-Wall", "-Wextra", "-g", "-O1", "-fsanitize=thread"
 #define CFLAGS "-Wall", "-Wextra", "-flto", "-O2"
 #define DEBUG_FLAGS "-Wall", "-Wextra", "-g3"
 
 static int debug_status;
+static int stats_status;
+static int bench_status;
+static int tsan_status;
+
+static const char *lib_src[] = { LIB_SRC, "src/liblambda.c" };
+
+// Object file of source is placed into LIB_DIR with same base name
+char *lib_object(const char *src)
+{
+    const char *base = strrchr(src, '/');
+    base = base ? base + 1 : src;
+
+    size_t n = strlen(LIB_DIR) + strlen(base) + 2;
+    char *obj = malloc(n);
+    snprintf(obj, n, "%s/%.*s.o", LIB_DIR, (int)(strlen(base) - 2), base);
+    return obj;
+}
+
+// Static and shared library for embedding, see src/liblambda.h
+bool build_lib(Bil_Cmd *cmd)
+{
+    size_t count = sizeof(lib_src) / sizeof(lib_src[0]);
+    if (!bil_dir_exist(LIB_DIR)) bil_mkdir(LIB_DIR);
+
+    Bil_Cmd ar = {0};
+    bil_cmd_append(&ar, "ar", "rcs", LIB_STATIC);
+
+    for (size_t i = 0; i < count; ++i) {
+        char *obj = lib_object(lib_src[i]);
+        cmd->count = 0;
+        bil_cmd_append(cmd, CC, LIB_CFLAGS, "-c", lib_src[i], "-o", obj);
+        if (!bil_cmd_run_sync(cmd)) return false;
+        bil_cmd_append(&ar, obj);
+    }
+
+    if (!bil_cmd_run_sync(&ar)) return false;
+
+    cmd->count = 0;
+    bil_cmd_append(cmd, CC, LIB_CFLAGS, "-shared");
+    bil_da_append_many(cmd, lib_src, count);
+    bil_cmd_append(cmd, "-o", LIB_SHARED, "-lm", "-lpthread");
+    return bil_cmd_run_sync(cmd);
+}
 
 void cmd_flags(int *argc, char ***argv)
 {
@@ -16,6 +73,12 @@ void cmd_flags(int *argc, char ***argv)
         char *flag = bil_shift_args(argc, argv);
         if (!strcmp(flag, "debug")) {
             debug_status = 1;
+        } else if (!strcmp(flag, "stats")) {
+            stats_status = 1;
+        } else if (!strcmp(flag, "bench")) {
+            bench_status = 1;
+        } else if (!strcmp(flag, "tsan")) {
+            tsan_status = 1;
         }
     }
 }
@@ -34,12 +97,52 @@ bil_workflow_begin();
     bil_cmd_append(&cmd, CC, "-ledit");
     if (debug_status) bil_cmd_append(&cmd, DEBUG_FLAGS);
     else bil_cmd_append(&cmd, CFLAGS);
+    if (stats_status) bil_cmd_append(&cmd, "-DARENA_STATS");
     bil_cmd_append(&cmd, SRC);
-    bil_cmd_append(&cmd, "-o", TAR);
+    bil_cmd_append(&cmd, "-o", TAR, "-lpthread");
 
     if (!bil_cmd_run_sync(&cmd))
         status = BIL_EXIT_FAILURE;
 
+    if (!build_lib(&cmd))
+        status = BIL_EXIT_FAILURE;
+
+    if (bench_status) {
+        cmd.count = 0;
+        bil_cmd_append(&cmd, CC, CFLAGS, "-Isrc");
+        bil_cmd_append(&cmd, LIB_SRC, BENCH_SRC);
+        bil_cmd_append(&cmd, "-o", BENCH_TAR, "-lm", "-lpthread");
+
+        if (!bil_cmd_run_sync(&cmd))
+            status = BIL_EXIT_FAILURE;
+
+        cmd.count = 0;
+        bil_cmd_append(&cmd, CC, CFLAGS, "-Isrc");
+        if (stats_status) bil_cmd_append(&cmd, "-DARENA_STATS");
+        bil_cmd_append(&cmd, LIB_SRC, PHASE_SRC);
+        bil_cmd_append(&cmd, "-o", PHASE_TAR, "-lm", "-lpthread");
+
+        if (!bil_cmd_run_sync(&cmd))
+            status = BIL_EXIT_FAILURE;
+
+        cmd.count = 0;
+        bil_cmd_append(&cmd, CC, CFLAGS, "-Isrc", LOAD_SRC, "-o", LOAD_TAR, "-lpthread");
+
+        if (!bil_cmd_run_sync(&cmd))
+            status = BIL_EXIT_FAILURE;
+    }
+
+    // Interpreters on many threads at once, checked by ThreadSanitizer
+    if (tsan_status) {
+        cmd.count = 0;
+        bil_cmd_append(&cmd, CC, TSAN_FLAGS, "-Isrc");
+        bil_cmd_append(&cmd, LIB_SRC, "src/liblambda.c", TSAN_SRC);
+        bil_cmd_append(&cmd, "-o", TSAN_TAR, "-lm", "-lpthread");
+
+        if (!bil_cmd_run_sync(&cmd))
+            status = BIL_EXIT_FAILURE;
+    }
+
 bil_workflow_end();
 
     return status;
@@ -1,11 +1,16 @@
 #include "arena.h"
 #include <stdint.h>
 
+// Region header and its data lives in one allocation
 Region *region_create(size_t capacity)
 {
-    Region *r = malloc(sizeof(Region));
+    Region *r = malloc(sizeof(Region) + capacity);
+    if (!r) {
+        fprintf(stderr, "error: cannot allocate region of %zu bytes\n", capacity);
+        exit(1);
+    }
 
-    r->data = malloc(capacity);
+    r->data = (char*)(r + 1);
     r->capacity = capacity;
     r->alloc_pos = 0;
     r->next = NULL;
@@ -13,48 +18,131 @@ Region *region_create(size_t capacity)
     return r;
 }
 
-void *arena_alloc_aligned(Arena *arena, size_t size, size_t alignment)
+#ifdef ARENA_STATS
+static Arena_Site *arena_site(Arena_Stats *st, const char *site)
+{
+    for (size_t i = 0; i < st->count; ++i) {
+        if (st->sites[i].site == site || !strcmp(st->sites[i].site, site))
+            return &st->sites[i];
+    }
+
+    // Sites that don't fit table are counted with last one
+    if (st->count == ARENA_SITES_CAPACITY) return &st->sites[st->count - 1];
+
+    st->sites[st->count].site = site;
+    return &st->sites[st->count++];
+}
+
+// `used` is signed change of bytes used in regions.
+// Notes without requested bytes only adds losses to site
+static void arena_stats_note(Arena *arena, const char *site, size_t requested,
+                             size_t padding, size_t garbage, long long used)
+{
+    Arena_Stats *st = &arena->stats;
+    st->used += used;
+    if (st->used > st->high_water) st->high_water = st->used;
+    if (!requested && !padding && !garbage) return;
+
+    Arena_Site *s = arena_site(st, site);
+
+    s->allocs += requested > 0;
+    s->requested += requested;
+    s->padding += padding;
+    s->garbage += garbage;
+}
+
+#define stats_note(arena, site, requested, padding, garbage, used) \
+    arena_stats_note(arena, site, requested, padding, garbage, used)
+#else
+#define stats_note(arena, site, requested, padding, garbage, used)
+#endif // ARENA_STATS
+
+// Every next region is twice bigger than previous
+static Region *arena_grow(Arena *arena, size_t size)
 {
-    size_t align_size = (size + (alignment - 1)) & ~(alignment - 1);
-    
-    if (!arena->head  && !arena->tail) {
-        Region *r = region_create(ARENA_CMP(align_size));
+    size_t capacity = arena->tail ? arena->tail->capacity * 2 : ARENA_DEFAULT_CAPACITY;
+    if (capacity > ARENA_MAX_CAPACITY) capacity = ARENA_MAX_CAPACITY;
+    if (capacity < size) capacity = size;
+
+    Region *r = region_create(capacity);
+#ifdef ARENA_STATS
+    arena->stats.regions += 1;
+    arena->stats.capacity += capacity;
+#endif
+
+    if (!arena->tail) {
         arena->head = r;
-        arena->tail = r;
+    } else {
+        r->next = arena->tail->next;
+        arena->tail->next = r;
     }
 
-    Region *cur = arena->head;
+    arena->tail = r;
+    return r;
+}
+
+void *arena_alloc_raw_at(Arena *arena, size_t size, size_t alignment ARENA_SITE_PARAM)
+{
+    Region *cur = arena->tail;
 
-    for (;;) {
-        if (!cur) {
-            Region* r = region_create(ARENA_CMP(align_size));
-            arena->tail->next = r;
-            arena->tail = r;
-            cur = arena->tail;
+    if (cur) {
+        size_t pos = (cur->alloc_pos + (alignment - 1)) & ~(alignment - 1);
+        if (pos + size <= cur->capacity) {
+            stats_note(arena, site, size, pos - cur->alloc_pos, 0, pos + size - cur->alloc_pos);
+            cur->alloc_pos = pos + size;
+            return cur->data + pos;
         }
 
-        if (cur->alloc_pos + align_size <= cur->capacity) {
-            char *ptr = (char*)(cur->data + cur->alloc_pos);
-            memset(ptr, 0, align_size);
-            cur->alloc_pos += align_size;
-            return ptr;
-        
-        } else {
-            cur = cur->next;
+        stats_note(arena, site, 0, cur->capacity - cur->alloc_pos, 0, 0);
+
+        // Regions after tail are left from reset, reuse next one if it fits
+        Region *next = cur->next;
+        if (next && next->capacity >= size) {
+            stats_note(arena, site, size, 0, 0, size);
+            next->alloc_pos = size;
+            arena->tail = next;
+            return next->data;
         }
     }
+
+    // Data of new region is aligned by malloc
+    stats_note(arena, site, size, 0, 0, size);
+    cur = arena_grow(arena, size);
+    cur->alloc_pos = size;
+    return cur->data;
 }
 
-void *arena_alloc(Arena *arena, size_t size)
+void *arena_alloc_aligned_at(Arena *arena, size_t size, size_t alignment ARENA_SITE_PARAM)
 {
-    return arena_alloc_aligned(arena, size, sizeof(void*));
+    void *ptr = arena_alloc_raw_at(arena, size, alignment ARENA_SITE_ARG(site));
+    memset(ptr, 0, size);
+    return ptr;
 }
 
-void *arena_realloc(Arena *arena, void *old_ptr, size_t old_size, size_t new_size)
+void *arena_alloc_at(Arena *arena, size_t size ARENA_SITE_PARAM)
 {
+    return arena_alloc_aligned_at(arena, size, sizeof(void*) ARENA_SITE_ARG(site));
+}
+
+// Last allocation of tail region grows and shrinks in place
+void *arena_realloc_at(Arena *arena, void *old_ptr, size_t old_size, size_t new_size ARENA_SITE_PARAM)
+{
+    Region *cur = arena->tail;
+
+    if (old_ptr && cur && (char*)old_ptr + old_size == cur->data + cur->alloc_pos) {
+        size_t pos = (char*)old_ptr - cur->data;
+        if (pos + new_size <= cur->capacity) {
+            stats_note(arena, site, new_size > old_size ? new_size - old_size : 0, 0, 0,
+                       (long long)new_size - (long long)old_size);
+            cur->alloc_pos = pos + new_size;
+            return old_ptr;
+        }
+    }
+
     if (new_size > old_size) {
-        void *new_ptr = arena_alloc(arena, new_size);
-        memcpy(new_ptr, old_ptr, old_size);
+        void *new_ptr = arena_alloc_raw_at(arena, new_size, sizeof(void*) ARENA_SITE_ARG(site));
+        if (old_size > 0) memcpy(new_ptr, old_ptr, old_size);
+        stats_note(arena, site, 0, 0, old_size, 0);
         return new_ptr;
     } else {
         return old_ptr;
@@ -66,19 +154,92 @@ void arena_dump(Arena *arena)
     size_t i = 1;
     Region *cur = arena->head;
     while (cur != NULL) {
-        printf("region %zu: %zu/%zu\n", i, cur->alloc_pos, cur->capacity);
+        printf("region %zu: %zu/%zu%s\n", i, cur->alloc_pos, cur->capacity,
+               cur == arena->tail ? " <- tail" : "");
         i += 1;
         cur = cur->next;
     }
 }
 
-void arena_reset(Arena *arena)
+Arena_Mark arena_mark(Arena *arena)
 {
-    Region *cur = arena->head;
-    while (cur != NULL) {
+    Arena_Mark mark = {0};
+    if (arena->tail) {
+        mark.region = arena->tail;
+        mark.alloc_pos = arena->tail->alloc_pos;
+    }
+    return mark;
+}
+
+// Regions stays allocated, so next allocations reuses them
+void arena_rewind(Arena *arena, Arena_Mark mark)
+{
+    if (!mark.region) {
+        if (!arena->head) return;
+        mark.region = arena->head;
+    }
+
+    // Regions after mark are used only up to current tail
+    Region *cur = mark.region->next;
+    while (cur != NULL && cur != arena->tail->next) {
         cur->alloc_pos = 0;
         cur = cur->next;
     }
+
+    mark.region->alloc_pos = mark.alloc_pos;
+    arena->tail = mark.region;
+
+#ifdef ARENA_STATS
+    arena->stats.used = 0;
+    for (cur = arena->head; cur != arena->tail->next; cur = cur->next)
+        arena->stats.used += cur->alloc_pos;
+#endif
+}
+
+int arena_after_mark(Arena *arena, Arena_Mark mark, const void *ptr)
+{
+    const char *p = ptr;
+    Region *r = mark.region ? mark.region : arena->head;
+    size_t from = mark.region ? mark.alloc_pos : 0;
+
+    for (; r != NULL && r != arena->tail->next; r = r->next, from = 0) {
+        if (p >= r->data + from && p < r->data + r->alloc_pos) return 1;
+    }
+
+    return 0;
+}
+
+// Counted without instrumentation, so it's cheap enough for measurements
+size_t arena_used(Arena *arena)
+{
+    size_t used = 0;
+    for (Region *cur = arena->head; cur && cur != arena->tail->next; cur = cur->next) used += cur->alloc_pos;
+    return used;
+}
+
+void arena_stats_dump(Arena *arena)
+{
+#ifdef ARENA_STATS
+    Arena_Stats *st = &arena->stats;
+    printf("%-16s %10s %12s %10s %10s\n", "site", "allocs", "requested", "padding", "garbage");
+
+    for (size_t i = 0; i < st->count; ++i) {
+        Arena_Site *s = &st->sites[i];
+        printf("%-16s %10zu %12zu %10zu %10zu\n",
+               s->site, s->allocs, s->requested, s->padding, s->garbage);
+    }
+
+    printf("regions: %zu, capacity: %zu, used: %zu, high water: %zu\n",
+           st->regions, st->capacity, st->used, st->high_water);
+#else
+    (void)arena;
+    printf("Arena statistics are compiled out. Rebuild with `./bin/build stats`\n");
+#endif
+}
+
+void arena_reset(Arena *arena)
+{
+    arena_rewind(arena, (Arena_Mark) {0});
 }
 
 void arena_free(Arena *arena)
@@ -86,8 +247,12 @@ void arena_free(Arena *arena)
     Region *cur = arena->head;
     while (cur != NULL) {
         Region *next = cur->next;
-        free(cur->data);
         free(cur);
         cur = next;
     }
+    arena->head = NULL;
+    arena->tail = NULL;
+#ifdef ARENA_STATS
+    arena->stats.used = 0;
+#endif
 }
@@ -6,7 +6,7 @@
 #include <string.h>
 
 #define ARENA_DEFAULT_CAPACITY (8 * 1024)
-#define ARENA_CMP(size) ((size) < ARENA_DEFAULT_CAPACITY ? ARENA_DEFAULT_CAPACITY : (size))
+#define ARENA_MAX_CAPACITY (64 * 1024 * 1024)
 
 typedef struct Region Region;
 
@@ -19,29 +19,95 @@ struct Region {
 
 Region *region_create(size_t capacity);
 
+/*
+ * Instrumentation is compiled in only with `ARENA_STATS` defined.
+ * Every allocation then is tagged by call site (function name by default),
+ * without it site arguments are dropped by preprocessor.
+ */
+#ifdef ARENA_STATS
+#define ARENA_SITES_CAPACITY 64
+
+typedef struct {
+    const char *site;
+    size_t allocs;    // Count of allocations and reallocations
+    size_t requested; // Bytes requested by caller
+    size_t padding;   // Bytes lost to alignment and region tails
+    size_t garbage;   // Bytes left behind by moving reallocations
+} Arena_Site;
+
+typedef struct {
+    Arena_Site sites[ARENA_SITES_CAPACITY];
+    size_t count;
+    size_t regions;    // Count of created regions
+    size_t capacity;   // Sum of capacities of regions
+    size_t used;       // Bytes used now
+    size_t high_water; // Max of used bytes
+} Arena_Stats;
+
+#define ARENA_SITE_PARAM , const char *site
+#define ARENA_SITE_ARG(s) , (s)
+#else
+#define ARENA_SITE_PARAM
+#define ARENA_SITE_ARG(s)
+#endif // ARENA_STATS
+
+#define ARENA_SITE __func__
+
+/*
+ * Allocations are made only from tail region.
+ * Regions after tail are empty and kept after reset for reuse.
+ */
 typedef struct {
     Region *head;
     Region *tail;
+#ifdef ARENA_STATS
+    Arena_Stats stats;
+#endif
 } Arena;
 
+// Saved position of arena
+typedef struct {
+    Region *region; // Tail region at the moment of mark. NULL if arena was empty
+    size_t alloc_pos;
+} Arena_Mark;
+
+Arena_Mark arena_mark(Arena *arena);
+void arena_rewind(Arena *arena, Arena_Mark mark); // Drops allocations made after mark
+int arena_after_mark(Arena *arena, Arena_Mark mark, const void *ptr); // Will pointer be dropped by rewind
+size_t arena_used(Arena *arena); // Bytes used in regions up to tail, alignment included
+
 void arena_dump(Arena *arena);
+void arena_stats_dump(Arena *arena);
 void arena_free(Arena *arena);
 void arena_reset(Arena *arena);
 
-void *arena_alloc(Arena *arena, size_t size);
-void *arena_alloc_aligned(Arena *arena, size_t size, size_t alignment);
-void *arena_realloc(Arena *arena, void *old_ptr, size_t old_size, size_t new_size);
+void *arena_alloc_at(Arena *arena, size_t size ARENA_SITE_PARAM);
+void *arena_alloc_aligned_at(Arena *arena, size_t size, size_t alignment ARENA_SITE_PARAM);
+void *arena_alloc_raw_at(Arena *arena, size_t size, size_t alignment ARENA_SITE_PARAM);
+void *arena_realloc_at(Arena *arena, void *old_ptr, size_t old_size, size_t new_size ARENA_SITE_PARAM);
 
-#define arena_da_append(a, da, item, c) \
+#define arena_alloc(a, size) \
+    arena_alloc_at((a), (size) ARENA_SITE_ARG(ARENA_SITE))
+#define arena_alloc_aligned(a, size, alignment) \
+    arena_alloc_aligned_at((a), (size), (alignment) ARENA_SITE_ARG(ARENA_SITE))
+#define arena_alloc_raw(a, size, alignment) /* Memory is not zeroed */ \
+    arena_alloc_raw_at((a), (size), (alignment) ARENA_SITE_ARG(ARENA_SITE))
+#define arena_realloc(a, old_ptr, old_size, new_size) \
+    arena_realloc_at((a), (old_ptr), (old_size), (new_size) ARENA_SITE_ARG(ARENA_SITE))
+
+#define arena_da_append_at(a, da, item, c, site) \
     do { \
         if ((da)->count + 1 >= (da)->capacity) { \
             size_t old_size = (da)->capacity*sizeof(*(da)->items); \
             (da)->capacity = (da)->capacity == 0 ? (c) : (da)->capacity*2; \
-            (da)->items = arena_realloc((a), (da)->items, old_size, (da)->capacity*sizeof(*(da)->items)); \
+            (da)->items = arena_realloc_at((a), (da)->items, old_size, (da)->capacity*sizeof(*(da)->items) \
+                                           ARENA_SITE_ARG(site)); \
         } \
         (da)->items[(da)->count++] = (item); \
     } while(0)
 
+#define arena_da_append(a, da, item, c) arena_da_append_at(a, da, item, c, ARENA_SITE)
+
 #define arena_da_append_many(a, da, item, item_count, c) \
     do { \
         if ((da)->count + (item_count) >= (da)->capacity) { \
@@ -0,0 +1,367 @@
+#include <string.h>
+#include "arith.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ARITH_X86
+#endif
+
+#define ARITH_SMALL 8      // Shorter buffers are reduced by plain loop
+#define PAIRWISE_BLOCK 128 // Size of block summed directly by pairwise summation
+
+typedef i64 (*Isum_Fn)(const i64 *xs, size_t n);
+typedef double (*Fred_Fn)(const double *xs, size_t n);
+
+/*
+ * Scalar kernels. Integers are accumulated as unsigned to wrap on overflow
+ */
+
+static i64 isum_scalar(const i64 *xs, size_t n)
+{
+    u64 acc[4] = {0};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc[0] += xs[i];
+        acc[1] += xs[i + 1];
+        acc[2] += xs[i + 2];
+        acc[3] += xs[i + 3];
+    }
+    for (; i < n; ++i) acc[0] += xs[i];
+    return (i64)(acc[0] + acc[1] + acc[2] + acc[3]);
+}
+
+static i64 iprod_scalar(const i64 *xs, size_t n)
+{
+    u64 acc[4] = {1, 1, 1, 1};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc[0] *= xs[i];
+        acc[1] *= xs[i + 1];
+        acc[2] *= xs[i + 2];
+        acc[3] *= xs[i + 3];
+    }
+    for (; i < n; ++i) acc[0] *= xs[i];
+    return (i64)(acc[0] * acc[1] * acc[2] * acc[3]);
+}
+
+static double fsum_scalar(const double *xs, size_t n)
+{
+    double acc[4] = {0};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc[0] += xs[i];
+        acc[1] += xs[i + 1];
+        acc[2] += xs[i + 2];
+        acc[3] += xs[i + 3];
+    }
+    for (; i < n; ++i) acc[0] += xs[i];
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+static double fprod_scalar(const double *xs, size_t n)
+{
+    double acc[4] = {1.0, 1.0, 1.0, 1.0};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc[0] *= xs[i];
+        acc[1] *= xs[i + 1];
+        acc[2] *= xs[i + 2];
+        acc[3] *= xs[i + 3];
+    }
+    for (; i < n; ++i) acc[0] *= xs[i];
+    return (acc[0] * acc[1]) * (acc[2] * acc[3]);
+}
+
+/*
+ * Vector kernels
+ */
+
+#ifdef ARITH_X86
+__attribute__((target("sse2")))
+static i64 isum_sse2(const i64 *xs, size_t n)
+{
+    __m128i a0 = _mm_setzero_si128(), a1 = a0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm_add_epi64(a0, _mm_loadu_si128((const __m128i*)(xs + i)));
+        a1 = _mm_add_epi64(a1, _mm_loadu_si128((const __m128i*)(xs + i + 2)));
+    }
+
+    u64 lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(a0, a1));
+    u64 acc = lanes[0] + lanes[1];
+    for (; i < n; ++i) acc += xs[i];
+    return (i64)acc;
+}
+
+__attribute__((target("sse2")))
+static double fsum_sse2(const double *xs, size_t n)
+{
+    __m128d a0 = _mm_setzero_pd(), a1 = a0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm_add_pd(a0, _mm_loadu_pd(xs + i));
+        a1 = _mm_add_pd(a1, _mm_loadu_pd(xs + i + 2));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(a0, a1));
+    double acc = lanes[0] + lanes[1];
+    for (; i < n; ++i) acc += xs[i];
+    return acc;
+}
+
+__attribute__((target("sse2")))
+static double fprod_sse2(const double *xs, size_t n)
+{
+    __m128d a0 = _mm_set1_pd(1.0), a1 = a0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm_mul_pd(a0, _mm_loadu_pd(xs + i));
+        a1 = _mm_mul_pd(a1, _mm_loadu_pd(xs + i + 2));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_mul_pd(a0, a1));
+    double acc = lanes[0] * lanes[1];
+    for (; i < n; ++i) acc *= xs[i];
+    return acc;
+}
+
+__attribute__((target("avx2")))
+static i64 isum_avx2(const i64 *xs, size_t n)
+{
+    __m256i a0 = _mm256_setzero_si256(), a1 = a0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a0 = _mm256_add_epi64(a0, _mm256_loadu_si256((const __m256i*)(xs + i)));
+        a1 = _mm256_add_epi64(a1, _mm256_loadu_si256((const __m256i*)(xs + i + 4)));
+    }
+
+    u64 lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(a0, a1));
+    u64 acc = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (; i < n; ++i) acc += xs[i];
+    return (i64)acc;
+}
+
+__attribute__((target("avx2")))
+static double fsum_avx2(const double *xs, size_t n)
+{
+    __m256d a0 = _mm256_setzero_pd(), a1 = a0, a2 = a0, a3 = a0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(xs + i));
+        a1 = _mm256_add_pd(a1, _mm256_loadu_pd(xs + i + 4));
+        a2 = _mm256_add_pd(a2, _mm256_loadu_pd(xs + i + 8));
+        a3 = _mm256_add_pd(a3, _mm256_loadu_pd(xs + i + 12));
+    }
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(xs + i));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+    double acc = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; ++i) acc += xs[i];
+    return acc;
+}
+
+__attribute__((target("avx2")))
+static double fprod_avx2(const double *xs, size_t n)
+{
+    __m256d a0 = _mm256_set1_pd(1.0), a1 = a0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a0 = _mm256_mul_pd(a0, _mm256_loadu_pd(xs + i));
+        a1 = _mm256_mul_pd(a1, _mm256_loadu_pd(xs + i + 4));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_mul_pd(a0, a1));
+    double acc = (lanes[0] * lanes[1]) * (lanes[2] * lanes[3]);
+    for (; i < n; ++i) acc *= xs[i];
+    return acc;
+}
+#endif // ARITH_X86
+
+static struct {
+    Isum_Fn isum;
+    Fred_Fn fsum;
+    Fred_Fn fprod;
+    const char *isa;
+} kernels = { isum_scalar, fsum_scalar, fprod_scalar, "scalar" };
+
+// Picks best kernels for current CPU before `main`
+__attribute__((constructor))
+static void arith_dispatch(void)
+{
+#ifdef ARITH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.isum = isum_avx2;
+        kernels.fsum = fsum_avx2;
+        kernels.fprod = fprod_avx2;
+        kernels.isa = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernels.isum = isum_sse2;
+        kernels.fsum = fsum_sse2;
+        kernels.fprod = fprod_sse2;
+        kernels.isa = "sse2";
+    }
+#endif
+}
+
+/*
+ * Float summation modes
+ */
+
+LAM_FUNC double fabsd(double x)
+{
+    return x < 0 ? -x : x;
+}
+
+static double fsum_seq(const double *xs, size_t n)
+{
+    double acc = 0.0;
+    for (size_t i = 0; i < n; ++i) acc += xs[i];
+    return acc;
+}
+
+static double fsum_pairwise(const double *xs, size_t n)
+{
+    if (n <= PAIRWISE_BLOCK) return kernels.fsum(xs, n);
+    size_t half = n / 2;
+    return fsum_pairwise(xs, half) + fsum_pairwise(xs + half, n - half);
+}
+
+static double fsum_kahan(const double *xs, size_t n)
+{
+    double sum = 0.0, c = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double t = sum + xs[i];
+        if (fabsd(sum) >= fabsd(xs[i])) c += (sum - t) + xs[i];
+        else c += (xs[i] - t) + sum;
+        sum = t;
+    }
+    return sum + c;
+}
+
+static double fsum(const double *xs, size_t n, Fsum_Mode mode)
+{
+    switch (mode) {
+        case FSUM_PAIRWISE: return fsum_pairwise(xs, n);
+        case FSUM_KAHAN: return fsum_kahan(xs, n);
+        case FSUM_SEQ: return fsum_seq(xs, n);
+        default: return n < ARITH_SMALL ? fsum_seq(xs, n) : kernels.fsum(xs, n);
+    }
+}
+
+/*
+ * Reductions
+ */
+
+// Wrapping arithmetic is associative, so integers are reduced in any order
+i64 arith_ireduce(Arith_Op op, const i64 *xs, size_t n)
+{
+    switch (op) {
+        case ARITH_ADD: {
+            if (n < ARITH_SMALL) return isum_scalar(xs, n);
+            return kernels.isum(xs, n);
+        }
+
+        case ARITH_SUB: {
+            u64 rest = n < ARITH_SMALL ? (u64)isum_scalar(xs + 1, n - 1)
+                                       : (u64)kernels.isum(xs + 1, n - 1);
+            return (i64)((u64)xs[0] - rest);
+        }
+
+        case ARITH_MUL: {
+            return iprod_scalar(xs, n);
+        }
+
+        case ARITH_DIV: {
+            i64 acc = 0;
+            arith_idiv(xs, n, &acc);
+            return acc;
+        }
+    }
+
+    return 0;
+}
+
+// Division by zero and `INT64_MIN / -1` trap in hardware, so divisors are checked first.
+// Callers check arity, but division of nothing is failure here too
+const char *arith_idiv(const i64 *xs, size_t n, i64 *out)
+{
+    if (n == 0) return "Division without arguments";
+
+    i64 acc = xs[0];
+    for (size_t i = 1; i < n; ++i) {
+        if (xs[i] == 0) return "Division by zero";
+        if (xs[i] == -1 && acc == INT64_MIN) return "Integer overflow in division";
+        acc /= xs[i];
+    }
+
+    *out = acc;
+    return NULL;
+}
+
+double arith_freduce(Arith_Op op, const double *xs, size_t n, Fsum_Mode mode)
+{
+    switch (op) {
+        case ARITH_ADD: {
+            return fsum(xs, n, mode);
+        }
+
+        case ARITH_SUB: {
+            if (mode == FSUM_SEQ || n < ARITH_SMALL) {
+                double acc = xs[0];
+                for (size_t i = 1; i < n; ++i) acc -= xs[i];
+                return acc;
+            }
+            return xs[0] - fsum(xs + 1, n - 1, mode);
+        }
+
+        case ARITH_MUL: {
+            if (mode == FSUM_SEQ || n < ARITH_SMALL) {
+                double acc = xs[0];
+                for (size_t i = 1; i < n; ++i) acc *= xs[i];
+                return acc;
+            }
+            return kernels.fprod(xs, n);
+        }
+
+        case ARITH_DIV: {
+            double acc = xs[0];
+            for (size_t i = 1; i < n; ++i) acc /= xs[i];
+            return acc;
+        }
+    }
+
+    return 0.0;
+}
+
+int arith_parse_fsum(const char *name, Fsum_Mode *mode)
+{
+    static const char *names[] = {
+        [FSUM_FAST]     = "fast",
+        [FSUM_PAIRWISE] = "pairwise",
+        [FSUM_KAHAN]    = "kahan",
+        [FSUM_SEQ]      = "seq",
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (!strcmp(names[i], name)) {
+            *mode = (Fsum_Mode)i;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+const char *arith_isa(void)
+{
+    return kernels.isa;
+}
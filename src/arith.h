@@ -0,0 +1,36 @@
+#ifndef ARITH_H_
+#define ARITH_H_
+
+#include "types.h"
+
+/*
+ * Kernels for n-ary arithmetic over contiguous typed buffers.
+ * All operations are left folds: `(- a b c)` is `a - b - c`.
+ * Vector versions are chosen at startup by features of CPU,
+ * table of kernels is never changed after, so it's shared by all interpreters.
+ */
+typedef enum {
+    ARITH_ADD = 0,
+    ARITH_SUB,
+    ARITH_MUL,
+    ARITH_DIV,
+} Arith_Op;
+
+// How floats are summed by `+` and `-`
+typedef enum {
+    FSUM_FAST = 0, // Vectorized, order of additions is not preserved
+    FSUM_PAIRWISE, // Pairwise summation, error grows as O(log n)
+    FSUM_KAHAN,    // Compensated (Neumaier) summation
+    FSUM_SEQ,      // Strict left to right order
+} Fsum_Mode;
+
+// Division which fails gives 0, use `arith_idiv` to check it
+LAM_API i64 arith_ireduce(Arith_Op op, const i64 *xs, size_t n);
+// Returns why division failed, NULL if it didn't
+LAM_API const char *arith_idiv(const i64 *xs, size_t n, i64 *out);
+LAM_API double arith_freduce(Arith_Op op, const double *xs, size_t n, Fsum_Mode mode);
+
+LAM_API int arith_parse_fsum(const char *name, Fsum_Mode *mode);
+LAM_API const char *arith_isa(void);
+
+#endif // ARITH_H_
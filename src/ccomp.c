@@ -0,0 +1,392 @@
+#include "ccomp.h"
+#include "native.h"
+#include "interp.h"
+#include "future.h"
+#include "profile.h"
+
+#define CCOMP_STACK_ARGS 16 // Typed arguments up to this count are kept on C stack
+
+#define ARG(n, i)     ((n)->as.call.args[i])
+#define IARG(n, i, c) (ARG(n, i)->ival(ARG(n, i), (c)))
+#define FARG(n, i, c) (ARG(n, i)->fval(ARG(n, i), (c)))
+
+/*
+ * Leaves
+ */
+
+static LObject c_const(CNode *n, CCtx *c) { (void)c; return n->as.k; }
+static i64 c_iconst(CNode *n, CCtx *c) { (void)c; return n->as.i; }
+static double c_fconst(CNode *n, CCtx *c) { (void)c; return n->as.f; }
+
+// Failure of typed subtree leaves boxed node, so it's not dropped with temporaries of caller
+static LObject c_ibox(CNode *n, CCtx *c)
+{
+    i64 v = n->ival(n, c);
+    return c->failed ? c->error : obj_int(c->a, v);
+}
+
+static LObject c_fbox(CNode *n, CCtx *c)
+{
+    double v = n->fval(n, c);
+    return c->failed ? c->error : obj_flt(v);
+}
+
+static LObject c_input(CNode *n, CCtx *c)
+{
+    if (n->as.input >= c->in.count) {
+        return obj_locate(obj_fail(c->a, "Input `$%zu` is not provided", n->as.input), n->at);
+    }
+    return c->in.items[n->as.input];
+}
+
+static LObject c_global(CNode *n, CCtx *c)
+{
+    Global *g = n->as.global;
+    if (!g->bound) {
+        return obj_locate(obj_fail(c->a, "Unbound variable `"SV_Fmt"`", SV_Args(g->name->sv)), n->at);
+    }
+    return g->value;
+}
+
+// Forms with lexical scope are evaluated by tree walker
+static LObject c_walk(CNode *n, CCtx *c)
+{
+    return obj_locate(eval_expr(c->I, c->a, n->as.e, c->in, NULL), n->at);
+}
+
+/*
+ * Casts into raw values. Type of dynamic value is checked only here
+ */
+
+// First failure is kept
+LAM_FUNC void c_fail(CCtx *c, LObject err, Loc at)
+{
+    if (c->failed) return;
+    c->error = obj_locate(err, at);
+    c->failed = 1;
+}
+
+// Operand which is not number fails the same way as argument of native in walker
+LAM_FUNC void c_fail_cast(CNode *n, CCtx *c, LObject o)
+{
+    if (c->failed) return;
+    if (!obj_is_none(o)) o = native_fail_type(c->a, n->as.cast.native, n->as.cast.arg, obj_type(o));
+    c_fail(c, o, n->at);
+}
+
+static i64 c_f2i(CNode *n, CCtx *c) { return (i64)n->as.cast.child->fval(n->as.cast.child, c); }
+static double c_i2f(CNode *n, CCtx *c) { return (double)n->as.cast.child->ival(n->as.cast.child, c); }
+
+static i64 c_dyn2i(CNode *n, CCtx *c)
+{
+    LObject o = n->as.cast.child->eval(n->as.cast.child, c);
+    switch (obj_type(o)) {
+        case OBJ_TYPE_INT: return obj_as_int(o);
+        case OBJ_TYPE_FLT: return (i64)obj_as_flt(o);
+        default: c_fail_cast(n, c, o); return 0;
+    }
+}
+
+static double c_dyn2f(CNode *n, CCtx *c)
+{
+    LObject o = n->as.cast.child->eval(n->as.cast.child, c);
+    switch (obj_type(o)) {
+        case OBJ_TYPE_FLT: return obj_as_flt(o);
+        case OBJ_TYPE_INT: return (double)obj_as_int(o);
+        default: c_fail_cast(n, c, o); return 0.0;
+    }
+}
+
+/*
+ * Typed arithmetic. Type of result is known from first argument
+ */
+
+static i64 c_iadd2(CNode *n, CCtx *c) { c->calls += 1; i64 x = IARG(n, 0, c); return (i64)((u64)x + (u64)IARG(n, 1, c)); }
+static i64 c_isub2(CNode *n, CCtx *c) { c->calls += 1; i64 x = IARG(n, 0, c); return (i64)((u64)x - (u64)IARG(n, 1, c)); }
+static i64 c_imul2(CNode *n, CCtx *c) { c->calls += 1; i64 x = IARG(n, 0, c); return (i64)((u64)x * (u64)IARG(n, 1, c)); }
+
+// Division which fails marks context and gives 0
+static i64 c_idiv2(CNode *n, CCtx *c)
+{
+    i64 xs[2], q = 0;
+    c->calls += 1;
+    xs[0] = IARG(n, 0, c);
+    xs[1] = IARG(n, 1, c);
+    const char *why = c->failed ? NULL : arith_idiv(xs, 2, &q);
+    if (why) c_fail(c, obj_fail(c->a, "%s", why), n->at);
+    return q;
+}
+
+// Sum goes through kernel, result depends on summation mode
+static double c_fadd2(CNode *n, CCtx *c) { c->calls += 1; double xs[2]; xs[0] = FARG(n, 0, c); xs[1] = FARG(n, 1, c); return arith_freduce(ARITH_ADD, xs, 2, c->I->fsum); }
+static double c_fsub2(CNode *n, CCtx *c) { c->calls += 1; double x = FARG(n, 0, c); return x - FARG(n, 1, c); }
+static double c_fmul2(CNode *n, CCtx *c) { c->calls += 1; double x = FARG(n, 0, c); return x * FARG(n, 1, c); }
+static double c_fdiv2(CNode *n, CCtx *c) { c->calls += 1; double x = FARG(n, 0, c); return x / FARG(n, 1, c); }
+
+static i64 c_iarith(CNode *n, CCtx *c)
+{
+    i64 stack[CCOMP_STACK_ARGS];
+    size_t count = n->as.call.count;
+    i64 *xs = count <= CCOMP_STACK_ARGS ? stack : arena_alloc_raw(c->a, sizeof(i64) * count, sizeof(i64));
+
+    c->calls += 1;
+    for (size_t i = 0; i < count; ++i) xs[i] = IARG(n, i, c);
+    if (n->as.call.op != ARITH_DIV) return arith_ireduce(n->as.call.op, xs, count);
+
+    i64 q = 0;
+    const char *why = c->failed ? NULL : arith_idiv(xs, count, &q);
+    if (why) c_fail(c, obj_fail(c->a, "%s", why), n->at);
+    return q;
+}
+
+static double c_farith(CNode *n, CCtx *c)
+{
+    double stack[CCOMP_STACK_ARGS];
+    size_t count = n->as.call.count;
+    double *xs = count <= CCOMP_STACK_ARGS ? stack : arena_alloc_raw(c->a, sizeof(double) * count, sizeof(double));
+
+    c->calls += 1;
+    for (size_t i = 0; i < count; ++i) xs[i] = FARG(n, i, c);
+    return arith_freduce(n->as.call.op, xs, count, c->I->fsum);
+}
+
+static const CNode_IFn iarith2[] = { c_iadd2, c_isub2, c_imul2, c_idiv2 };
+static const CNode_FFn farith2[] = { c_fadd2, c_fsub2, c_fmul2, c_fdiv2 };
+
+/*
+ * Dynamic calls
+ */
+
+static LObject c_call(CNode *n, CCtx *c)
+{
+    size_t count = n->as.call.count;
+    Arena_Mark mark = arena_mark(c->a);
+    LObject *args = arena_alloc_raw(c->a, sizeof(LObject) * count, sizeof(LObject));
+
+    for (size_t i = 0; i < count; ++i) {
+        args[i] = ARG(n, i)->eval(ARG(n, i), c);
+        if (obj_is_none(args[i])) return obj_locate(eval_leave(c->a, mark, args[i]), n->at);
+    }
+
+    return obj_locate(eval_leave(c->a, mark, native_call(c->I, c->a, n->as.call.native, args, count)), n->at);
+}
+
+// Operands of binary arithmetic are known only at run time.
+// Small integers and floats are handled inline if `iok` holds, everything else by native.
+// Small integers never reach INT64_MIN, so only zero divisor is left to native to fail
+#define C_DYN2(name, iok, iexpr, fexpr) \
+    static LObject name(CNode *n, CCtx *c) \
+    { \
+        LObject args[2]; \
+        args[0] = ARG(n, 0)->eval(ARG(n, 0), c); \
+        if (obj_is_none(args[0])) return obj_locate(args[0], n->at); \
+        args[1] = ARG(n, 1)->eval(ARG(n, 1), c); \
+        if (obj_is_none(args[1])) return obj_locate(args[1], n->at); \
+        if (obj_is_boxed(args[0]) && obj_tag(args[0]) == NB_INT && \
+            obj_is_boxed(args[1]) && obj_tag(args[1]) == NB_INT) { \
+            i64 x = obj_as_int(args[0]), y = obj_as_int(args[1]); \
+            if (iok) { c->calls += 1; return obj_int(c->a, iexpr); } \
+        } \
+        if (!obj_is_boxed(args[0]) && !obj_is_boxed(args[1])) { \
+            double x = obj_as_flt(args[0]), y = obj_as_flt(args[1]); \
+            c->calls += 1; \
+            return obj_flt(fexpr); \
+        } \
+        return obj_locate(native_call(c->I, c->a, n->as.call.native, args, 2), n->at); \
+    }
+
+C_DYN2(c_dyn_add2, 1, x + y, arith_freduce(ARITH_ADD, (double[]) { x, y }, 2, c->I->fsum))
+C_DYN2(c_dyn_sub2, 1, x - y, x - y)
+C_DYN2(c_dyn_mul2, 1, (i64)((u64)x * (u64)y), x * y)
+C_DYN2(c_dyn_div2, y != 0, x / y, x / y)
+
+static const CNode_Fn dyn2[] = { c_dyn_add2, c_dyn_sub2, c_dyn_mul2, c_dyn_div2 };
+
+/*
+ * Compilation
+ */
+
+LAM_FUNC CNode *cnode_new(Arena *a)
+{
+    return arena_alloc(a, sizeof(CNode));
+}
+
+LAM_FUNC int cnode_is_const(CNode *n)
+{
+    return n->eval == c_const || n->ival == c_iconst || n->fval == c_fconst;
+}
+
+LAM_FUNC CNode *cnode_walk(Arena *a, Expr *e)
+{
+    CNode *n = cnode_new(a);
+    n->eval = c_walk;
+    n->as.e = e;
+    return n;
+}
+
+LAM_FUNC CNode *cnode_int(Arena *a, i64 i)
+{
+    CNode *n = cnode_new(a);
+    n->eval = c_ibox;
+    n->ival = c_iconst;
+    n->as.i = i;
+    return n;
+}
+
+LAM_FUNC CNode *cnode_flt(Arena *a, double f)
+{
+    CNode *n = cnode_new(a);
+    n->eval = c_fbox;
+    n->fval = c_fconst;
+    n->as.f = f;
+    return n;
+}
+
+// Argument `i` of call `parent` is converted to type `t`
+LAM_FUNC CNode *cnode_cast(Arena *a, CNode *parent, size_t i, LObj_Type t)
+{
+    CNode *child = ARG(parent, i);
+    CNode *n = cnode_new(a);
+    n->as.cast = (CNode_Cast) { .child = child, .native = parent->as.call.native, .arg = i };
+    n->at = parent->at;
+
+    if (t == OBJ_TYPE_INT) {
+        n->eval = c_ibox;
+        n->ival = child->fval ? c_f2i : c_dyn2i;
+    } else {
+        n->eval = c_fbox;
+        n->fval = child->ival ? c_i2f : c_dyn2f;
+    }
+
+    return n;
+}
+
+// Subtree of constants is evaluated once while compiling.
+// Division which may fail is left for run time, so its error is reported there
+LAM_FUNC CNode *cnode_fold(Interp *I, Arena *a, CNode *n)
+{
+    for (size_t i = 0; i < n->as.call.count; ++i) {
+        if (!cnode_is_const(ARG(n, i))) return n;
+    }
+
+    if (n->ival && n->as.call.op == ARITH_DIV) {
+        for (size_t i = 1; i < n->as.call.count; ++i) {
+            if (ARG(n, i)->as.i == 0 || ARG(n, i)->as.i == -1) return n;
+        }
+    }
+
+    CCtx c = { .I = I, .a = a };
+    if (n->ival) return cnode_int(a, n->ival(n, &c));
+    return cnode_flt(a, n->fval(n, &c));
+}
+
+LAM_FUNC CNode *ccomp_node(Interp *I, Arena *a, Expr *e, size_t depth);
+
+LAM_FUNC CNode *ccomp_call(Interp *I, Arena *a, Expr *e, size_t depth)
+{
+    Funcall *f = e->v.f;
+    Native *native = f->native ? f->native : native_find(I, f->name);
+    size_t count = f->args.count;
+
+    // Errors of unknown functions, arity and too deep nesting are reported by walker at run time
+    if (f->callee.t != EXPR_NONE || !native || count < native->min_args || count > native->max_args ||
+        depth >= EXPR_DEPTH_MAX)
+        return cnode_walk(a, e);
+
+    CNode *n = cnode_new(a);
+    n->as.call.args = arena_alloc(a, sizeof(CNode*) * count);
+    n->as.call.count = count;
+    n->as.call.native = native;
+    n->as.call.f = f;
+    n->at = f->at;
+
+    for (size_t i = 0; i < count; ++i) ARG(n, i) = ccomp_node(I, a, &f->args.items[i], depth + 1);
+
+    if (native->op < 0 || (!ARG(n, 0)->ival && !ARG(n, 0)->fval)) {
+        n->eval = count == 2 && native->op >= 0 ? dyn2[native->op] : c_call;
+        return n;
+    }
+
+    Arith_Op op = (Arith_Op)native->op;
+    n->as.call.op = op;
+
+    if (ARG(n, 0)->ival) {
+        for (size_t i = 1; i < count; ++i) {
+            if (!ARG(n, i)->ival) ARG(n, i) = cnode_cast(a, n, i, OBJ_TYPE_INT);
+        }
+        n->eval = c_ibox;
+        n->ival = count == 2 ? iarith2[op] : c_iarith;
+    } else {
+        for (size_t i = 1; i < count; ++i) {
+            if (!ARG(n, i)->fval) ARG(n, i) = cnode_cast(a, n, i, OBJ_TYPE_FLT);
+        }
+        n->eval = c_fbox;
+        n->fval = count == 2 ? farith2[op] : c_farith;
+    }
+
+    return cnode_fold(I, a, n);
+}
+
+// Depth is count of calls above node
+LAM_FUNC CNode *ccomp_node(Interp *I, Arena *a, Expr *e, size_t depth)
+{
+    switch (e->t) {
+        case EXPR_ATOM: {
+            Atom *atom = &e->v.a;
+            if (atom->t == ATOM_INT) return cnode_int(a, atom->v.as_int);
+            if (atom->t == ATOM_FLT) return cnode_flt(a, atom->v.as_flt);
+
+            CNode *n = cnode_new(a);
+            n->eval = c_const;
+            n->as.k = atom->t == ATOM_STR ? obj_str(&atom->v.as_str->sv) : OBJ_NIL;
+            return n;
+        }
+
+        case EXPR_INPUT: {
+            CNode *n = cnode_new(a);
+            n->eval = c_input;
+            n->as.input = e->v.input;
+            return n;
+        }
+
+        case EXPR_GLOBAL: {
+            CNode *n = cnode_new(a);
+            n->eval = c_global;
+            n->as.global = e->v.global;
+            return n;
+        }
+
+        case EXPR_FUNCALL: {
+            return ccomp_call(I, a, e, depth);
+        }
+
+        default: {
+            return cnode_walk(a, e);
+        }
+    }
+}
+
+CNode *ccomp_expr(Interp *I, Arena *a, Expr *e)
+{
+    return ccomp_node(I, a, e, 0);
+}
+
+// Root which is not call gets place of form
+CNode *ccomp_statement(Interp *I, Arena *a, Statement *s)
+{
+    CNode *n = ccomp_expr(I, a, &s->v.e);
+    if (!n->at.row) n->at = s->at;
+    return n;
+}
+
+LObject ccomp_run(Interp *I, Arena *a, CNode *n, Inputs in)
+{
+    CCtx c = { .I = I, .a = a, .in = in };
+    Arena_Mark mark = arena_mark(a);
+
+    LObject out = n->eval(n, &c);
+    if (c.failed) out = c.error;
+    if (I->prof) prof_funcalls(I->prof, c.calls);
+
+    return pool_leave(I, a, eval_leave(a, mark, out));
+}
@@ -0,0 +1,66 @@
+#ifndef CCOMP_H_
+#define CCOMP_H_
+
+#include "types.h"
+#include "arena.h"
+#include "eval.h"
+
+/*
+ * Closure compilation: tree of expression is turned into tree of nodes,
+ * where every node has function specialized by operator and types of arguments.
+ * Nodes of statically known type also have raw version of function,
+ * so typed arithmetic never boxes intermediate values.
+ * Forms with lexical scope (let, lambda, if, calls of closures) are left for tree walker.
+ */
+typedef struct CNode CNode;
+
+typedef struct {
+    Interp *I;
+    Arena *a;
+    Inputs in;
+    int failed;    // Set by typed nodes, which cannot return failure
+    LObject error; // First failure, returned by every boxed node after it
+    size_t calls;  // Arithmetic evaluated by nodes, natives and walker count their own
+} CCtx;
+
+typedef LObject (*CNode_Fn)(CNode *n, CCtx *c);
+typedef i64 (*CNode_IFn)(CNode *n, CCtx *c);
+typedef double (*CNode_FFn)(CNode *n, CCtx *c);
+
+typedef struct {
+    CNode **args;
+    size_t count;
+    Arith_Op op;
+    Native *native;
+    Funcall *f;
+} CNode_Call;
+
+// Argument `arg` of native, which is converted to type of call
+typedef struct {
+    CNode *child;
+    Native *native;
+    size_t arg;
+} CNode_Cast;
+
+struct CNode {
+    CNode_Fn eval;  // Boxed result, every node has it
+    CNode_IFn ival; // Not NULL only if node is integer
+    CNode_FFn fval; // Not NULL only if node is float
+    Loc at;         // Place given to failure of node, if it doesn't have one
+    union {
+        LObject k;
+        i64 i;
+        double f;
+        size_t input;
+        Global *global;
+        CNode_Cast cast;
+        CNode_Call call;
+        Expr *e;
+    } as;
+};
+
+LAM_API CNode *ccomp_expr(Interp *I, Arena *a, Expr *e);
+LAM_API CNode *ccomp_statement(Interp *I, Arena *a, Statement *s);
+LAM_API LObject ccomp_run(Interp *I, Arena *a, CNode *n, Inputs in);
+
+#endif // CCOMP_H_
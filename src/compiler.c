@@ -0,0 +1,170 @@
+#include "vm.h"
+#include "parser.h"
+#include "eval.h"
+#include "native.h"
+#include "interp.h"
+
+typedef struct {
+    Interp *I;
+    Arena *a;
+    Chunk *c;
+    size_t depth; // Current depth of stack
+    size_t calls; // Calls being compiled, nesting of recursion
+    Loc at;       // Innermost call being compiled, place of failures
+    LObject error;
+    int walk;     // Form is left to tree walker
+} Compiler;
+
+// Failure of form is reported like failure of evaluation, with place of call
+LAM_FUNC int compile_fail(Compiler *cm, LObject err)
+{
+    cm->error = obj_locate(err, cm->at);
+    return 0;
+}
+
+LAM_FUNC int compile_walk(Compiler *cm)
+{
+    cm->walk = 1;
+    return 0;
+}
+
+LAM_FUNC void compiler_push(Compiler *cm, size_t n)
+{
+    cm->depth += n;
+    if (cm->depth > cm->c->stack_max)
+        cm->c->stack_max = cm->depth;
+}
+
+LAM_FUNC void emit_const(Compiler *cm, Const k)
+{
+    size_t idx = cm->c->consts.count;
+    const_append(cm->a, cm->c, k);
+
+    if (idx <= INST_MAX) {
+        code_append(cm->a, cm->c, OP_CONST);
+        code_append(cm->a, cm->c, idx);
+    } else {
+        code_append(cm->a, cm->c, OP_CONSTW);
+        code_append(cm->a, cm->c, idx & INST_MAX);
+        code_append(cm->a, cm->c, idx >> 16);
+    }
+
+    compiler_push(cm, 1);
+}
+
+// Reduces `n` values from top of stack into one, `at` is kept for instruction which may fail
+LAM_FUNC void emit_reduce(Compiler *cm, Opcode op, size_t n, Loc at)
+{
+    if (op == OP_IDIV) loc_append(cm->a, cm->c, ((Code_Loc) { cm->c->code.count, at }));
+    code_append(cm->a, cm->c, op);
+    code_append(cm->a, cm->c, n);
+    cm->depth -= n - 1;
+}
+
+LAM_FUNC Opcode arethop(Arith_Op op, LObj_Type t)
+{
+    return (t == OBJ_TYPE_FLT ? OP_FADD : OP_IADD) + op;
+}
+
+LAM_FUNC int compile_expr(Compiler *cm, Expr *e, LObj_Type *t);
+
+LAM_FUNC int compile_funcall(Compiler *cm, Funcall *f, LObj_Type *t)
+{
+    Arena *a = cm->a;
+    cm->at = f->at;
+
+    if (f->callee.t != EXPR_NONE) return compile_walk(cm);
+
+    Native *n = f->native ? f->native : native_find(cm->I, f->name);
+    if (!n) return compile_fail(cm, obj_fail(a, "Unknown function name `"SV_Fmt"`", SV_Args(f->name->sv)));
+
+    if (n->op < 0) return compile_walk(cm);
+
+    // Arguments are compiled before checks of arity and types, as walker evaluates
+    // them before call. So failure of later argument, or form left to walker, wins
+    LObject fail = OBJ_NIL;
+    Opcode op = OP_IADD;
+    size_t pending = 0;
+
+    for (size_t i = 0; i < f->args.count; ++i) {
+        LObj_Type at;
+        if (!compile_expr(cm, &f->args.items[i], &at)) return 0;
+
+        // Type of result is defined by first argument, rest casts to it
+        if (i == 0) {
+            *t = at;
+            op = arethop((Arith_Op)n->op, at);
+        }
+
+        if (at != OBJ_TYPE_INT && at != OBJ_TYPE_FLT) {
+            if (!obj_is_none(fail)) fail = native_fail_type(a, n, i, at);
+        } else if (at != *t) {
+            code_append(a, cm->c, *t == OBJ_TYPE_FLT ? OP_I2F : OP_F2I);
+        }
+
+        // Operand is single instruction word, so very wide calls
+        // reduces by parts. Left fold keeps result of `-` and `/` same
+        if (++pending == INST_MAX) {
+            emit_reduce(cm, op, pending, f->at);
+            pending = 1;
+        }
+    }
+
+    cm->at = f->at;
+    if (f->args.count == 0)
+        return compile_fail(cm, obj_fail(a, "Function `"SV_Fmt"` expects at least 1 argument, but provided 0", SV_Args(f->name->sv)));
+    if (obj_is_none(fail)) return compile_fail(cm, fail);
+
+    if (pending > 1) emit_reduce(cm, op, pending, f->at);
+    cm->c->calls += 1;
+    return 1;
+}
+
+LAM_FUNC int compile_expr(Compiler *cm, Expr *e, LObj_Type *t)
+{
+    switch (e->t) {
+        case EXPR_ATOM: {
+            Const k = {0};
+            Atom *atom = &e->v.a;
+            switch (atom->t) {
+                case ATOM_INT: k.t = OBJ_TYPE_INT; k.v.i = atom->v.as_int; break;
+                case ATOM_FLT: k.t = OBJ_TYPE_FLT; k.v.f = atom->v.as_flt; break;
+                case ATOM_STR: k.t = OBJ_TYPE_STR; k.v.s = &atom->v.as_str->sv; break;
+                default: k.t = OBJ_TYPE_NIL; break;
+            }
+            emit_const(cm, k);
+            *t = k.t;
+            return 1;
+        }
+
+        case EXPR_FUNCALL: {
+            if (cm->calls >= EXPR_DEPTH_MAX)
+                return compile_fail(cm, obj_fail(cm->a, "Expression is nested deeper than %d calls", EXPR_DEPTH_MAX));
+            cm->calls += 1;
+            int ok = compile_funcall(cm, e->v.f, t);
+            cm->calls -= 1;
+            return ok;
+        }
+
+        // Types of inputs and variables are known only at run time
+        default:
+            return compile_walk(cm);
+    }
+}
+
+Compile_Result compile_statement(Interp *I, Arena *a, Chunk *c, Statement *s, LObject *error)
+{
+    Compiler cm = { .I = I, .a = a, .c = c, .at = s->at, .error = OBJ_NIL };
+    LObj_Type t = OBJ_TYPE_NIL;
+
+    if (s->t != STATEMENT_VOID) return COMPILE_WALK;
+    if (!compile_expr(&cm, &s->v.e, &t)) {
+        if (cm.walk) return COMPILE_WALK;
+        *error = cm.error;
+        return COMPILE_FAIL;
+    }
+
+    code_append(a, c, OP_RET);
+    c->t = t;
+    return COMPILE_OK;
+}
@@ -0,0 +1,96 @@
+#include "env.h"
+#include "intern.h"
+#include "parser.h"
+#include "interp.h"
+
+static void globals_grow(Globals *g)
+{
+    size_t capacity = g->capacity ? g->capacity * 2 : GLOBALS_INIT_CAPACITY;
+    Global_Slot *slots = arena_alloc(&g->arena, sizeof(Global_Slot) * capacity);
+
+    for (size_t i = 0; i < g->capacity; ++i) {
+        Global_Slot s = g->slots[i];
+        if (!s.name) continue;
+
+        size_t j = s.name->hash & (capacity - 1);
+        while (slots[j].name) j = (j + 1) & (capacity - 1);
+        slots[j] = s;
+    }
+
+    g->slots = slots;
+    g->capacity = capacity;
+}
+
+static Global_Slot *globals_slot(Globals *g, Symbol *name)
+{
+    if (!g->capacity) globals_grow(g);
+
+    size_t mask = g->capacity - 1;
+    size_t i = name->hash & mask;
+    while (g->slots[i].name && g->slots[i].name != name) i = (i + 1) & mask;
+    return &g->slots[i];
+}
+
+// Creates unbound entry if name is not known yet
+Global *global_get(Interp *I, Symbol *name)
+{
+    Globals *globals = &I->globals;
+    if ((globals->count + 1) * 10 > globals->capacity * 7) globals_grow(globals);
+
+    Global_Slot *s = globals_slot(globals, name);
+    if (!s->name) {
+        s->name = name;
+        s->global = arena_alloc(&globals->arena, sizeof(Global));
+        s->global->name = name;
+        s->global->value = OBJ_NIL;
+        globals->count += 1;
+    }
+
+    return s->global;
+}
+
+Global *global_find(Interp *I, Symbol *name)
+{
+    return globals_slot(&I->globals, name)->global;
+}
+
+// Object is copied out of arena of form, which is dropped after evaluation.
+// Strings are interned, big integers are reboxed, closures are copied with body
+static LObject global_persist(Interp *I, Arena *a, LObject o)
+{
+    switch (obj_type(o)) {
+        case OBJ_TYPE_INT: {
+            return obj_int(a, obj_as_int(o));
+        }
+
+        case OBJ_TYPE_STR: {
+            return obj_str(&intern(I, *obj_as_str(o))->sv);
+        }
+
+        case OBJ_TYPE_FUNC: {
+            Closure *c = obj_as_func(o);
+            if (arena_after_mark(a, (Arena_Mark) {0}, c)) return o;
+
+            size_t n = c->fn->captures.count;
+            Closure *copy = arena_alloc(a, sizeof(Closure) + sizeof(LObject) * n);
+            copy->fn = expr_copy(a, (Expr) { .t = EXPR_LAMBDA, .v.lambda = c->fn }).v.lambda;
+            for (size_t i = 0; i < n; ++i) copy->captured[i] = global_persist(I, a, c->captured[i]);
+            return obj_func(copy);
+        }
+
+        default: return o;
+    }
+}
+
+void global_define(Interp *I, Global *g, LObject value)
+{
+    g->value = global_persist(I, &I->globals.arena, value);
+    g->bound = 1;
+}
+
+Env *env_new(Arena *a, Env *parent, size_t count)
+{
+    Env *env = arena_alloc_raw(a, sizeof(Env) + sizeof(LObject) * count, sizeof(void*));
+    env->parent = parent;
+    return env;
+}
@@ -0,0 +1,55 @@
+#ifndef ENV_H_
+#define ENV_H_
+
+#include "types.h"
+#include "arena.h"
+
+/*
+ * Global variable. Parser resolves names into pointers to these,
+ * so entry is created on first reference and bound by `define` later.
+ */
+struct Global {
+    Symbol *name;
+    LObject value;
+    int bound;
+};
+
+typedef struct {
+    Symbol *name;
+    Global *global;
+} Global_Slot;
+
+// Open addressing table keyed by interned name.
+// Entries and values are kept in own arena, so they outlive every form
+typedef struct {
+    Global_Slot *slots;
+    size_t capacity;
+    size_t count;
+    Arena arena;
+} Globals;
+
+#define GLOBALS_INIT_CAPACITY 64 // Must be power of two
+
+/*
+ * Frame of lexical scope at run time.
+ * Parser resolves local variable into (depth, slot):
+ * count of parents to walk and index in their slots.
+ */
+typedef struct Env {
+    struct Env *parent;
+    LObject slots[];
+} Env;
+
+LAM_API Global *global_get(Interp *I, Symbol *name);
+LAM_API Global *global_find(Interp *I, Symbol *name);
+LAM_API void global_define(Interp *I, Global *g, LObject value);
+
+LAM_API Env *env_new(Arena *a, Env *parent, size_t count);
+
+LAM_FUNC LObject env_lookup(Env *env, Local var)
+{
+    for (u32 i = 0; i < var.depth; ++i) env = env->parent;
+    return env->slots[var.slot];
+}
+
+#endif // ENV_H_
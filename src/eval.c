@@ -0,0 +1,260 @@
+#include <assert.h>
+#include "eval.h"
+#include "arith.h"
+#include "native.h"
+#include "interp.h"
+#include "future.h"
+#include "profile.h"
+
+// Strings refers to interned symbols
+LAM_FUNC LObject eval_atom(Arena *a, Atom *atom)
+{
+    switch (atom->t) {
+        case ATOM_INT: return obj_int(a, atom->v.as_int);
+        case ATOM_FLT: return obj_flt(atom->v.as_flt);
+        case ATOM_STR: return obj_str(&atom->v.as_str->sv);
+        default: return OBJ_NIL;
+    }
+}
+
+static _Thread_local size_t eval_depth; // Including futures run by touch on the same stack
+
+// Closure keeps only values of captured variables
+LAM_FUNC LObject eval_lambda(Arena *a, Lambda *fn, Env *env)
+{
+    size_t n = fn->captures.count;
+    Closure *c = arena_alloc_raw(a, sizeof(Closure) + sizeof(LObject) * n, sizeof(void*));
+
+    c->fn = fn;
+    for (size_t i = 0; i < n; ++i) c->captured[i] = env_lookup(env, fn->captures.items[i]);
+
+    return obj_func(c);
+}
+
+LObject statfuncall(Interp *I, Arena *a, Funcall *f, Inputs in, Env *env)
+{
+    // Function could be registered after statement was parsed
+    Native *n = f->native ? f->native : native_find(I, f->name);
+    if (!n) return obj_locate(obj_fail(a, "Unknown function name `"SV_Fmt"`", SV_Args(f->name->sv)), f->at);
+
+    Arena_Mark mark = arena_mark(a);
+    LObject *args = arena_alloc_raw(a, sizeof(LObject) * f->args.count, sizeof(LObject));
+
+    for (size_t i = 0; i < f->args.count; ++i) {
+        args[i] = eval_expr(I, a, &f->args.items[i], in, env);
+        if (obj_is_none(args[i])) return obj_locate(eval_leave(a, mark, args[i]), f->at);
+    }
+
+    LObject out = native_call(I, a, n, args, f->args.count);
+    return obj_locate(eval_leave(a, mark, out), f->at);
+}
+
+// Tail positions (body of closure and `let`, branches of `if`) are evaluated
+// by next iteration of loop, so tail calls don't grow C stack. Before tail call
+// everything allocated by previous iterations is dropped, if call doesn't refer to it.
+// Failure without place gets place of innermost call
+LObject eval_expr(Interp *I, Arena *a, Expr *e, Inputs in, Env *env)
+{
+    if (eval_depth >= EXPR_DEPTH_MAX) return obj_fail(a, "Expression is nested deeper than %d calls", EXPR_DEPTH_MAX);
+    eval_depth += 1;
+
+    Arena_Mark base = arena_mark(a);
+    LObject out = OBJ_NONE;
+    Funcall *call = NULL;
+
+    for (;;) {
+        switch (e->t) {
+            case EXPR_ATOM: {
+                out = eval_atom(a, &e->v.a);
+                goto leave;
+            }
+
+            case EXPR_LOCAL: {
+                out = env_lookup(env, e->v.local);
+                goto leave;
+            }
+
+            case EXPR_GLOBAL: {
+                Global *g = e->v.global;
+                if (!g->bound) {
+                    out = obj_fail(a, "Unbound variable `"SV_Fmt"`", SV_Args(g->name->sv));
+                    goto leave;
+                }
+                out = g->value;
+                goto leave;
+            }
+
+            case EXPR_INPUT: {
+                if (e->v.input >= in.count) {
+                    out = obj_fail(a, "Input `$%zu` is not provided", e->v.input);
+                    goto leave;
+                }
+                out = in.items[e->v.input];
+                goto leave;
+            }
+
+            // Futures read globals without locks, so they are joined before change
+            case EXPR_DEFINE: {
+                if (future_in_task()) {
+                    out = obj_fail(a, "`define` is not allowed inside future");
+                    goto leave;
+                }
+
+                out = eval_expr(I, a, &e->v.def->value, in, env);
+                if (obj_is_none(out)) goto leave;
+                if (I->pool) {
+                    pool_wait(I, a);
+                    out = future_resolve(I, a, out);
+                    if (obj_is_none(out)) goto leave;
+                }
+                global_define(I, e->v.def->global, out);
+                goto leave;
+            }
+
+            case EXPR_LAMBDA: {
+                out = eval_lambda(a, e->v.lambda, env);
+                goto leave;
+            }
+
+            case EXPR_FUTURE: {
+                out = future_spawn(I, e->v.lambda, in, env);
+                goto leave;
+            }
+
+            case EXPR_IF: {
+                LObject c = eval_expr(I, a, &e->v.cond->cond, in, env);
+                if (obj_is_none(c)) {
+                    out = c;
+                    goto leave;
+                }
+
+                e = obj_is_true(c) ? &e->v.cond->then : &e->v.cond->otherwise;
+                if (e->t == EXPR_NONE) {
+                    out = OBJ_NIL;
+                    goto leave;
+                }
+                continue;
+            }
+
+            case EXPR_LET: {
+                Let *let = e->v.let;
+                Env *frame = env_new(a, env, let->inits.count);
+
+                for (size_t i = 0; i < let->inits.count; ++i) {
+                    frame->slots[i] = eval_expr(I, a, &let->inits.items[i], in, env);
+                    if (obj_is_none(frame->slots[i])) {
+                        out = frame->slots[i];
+                        goto leave;
+                    }
+                }
+
+                env = frame;
+                e = &let->body;
+                continue;
+            }
+
+            case EXPR_FUNCALL: {
+                Funcall *f = e->v.f;
+                call = f;
+                if (f->callee.t == EXPR_NONE) {
+                    out = statfuncall(I, a, f, in, env);
+                    goto leave;
+                }
+
+                LObject fn = eval_expr(I, a, &f->callee, in, env);
+                if (obj_is_none(fn)) {
+                    out = fn;
+                    goto leave;
+                }
+
+                // Name of non function without arguments is just its value
+                if (obj_type(fn) != OBJ_TYPE_FUNC) {
+                    if (f->args.count == 0) out = fn;
+                    else out = obj_fail(a, "`"SV_Fmt"` is not a function", SV_Args(f->name->sv));
+                    goto leave;
+                }
+
+                if (I->prof) prof_funcall(I->prof);
+
+                Closure *c = obj_as_func(fn);
+                u32 arity = c->fn->arity;
+                if (f->args.count != arity) {
+                    out = obj_fail(a, "Function `"SV_Fmt"` expects %u argument%s, but provided %zu",
+                                   SV_Args(f->name->sv), arity, plural_s(arity), f->args.count);
+                    goto leave;
+                }
+
+                size_t size = sizeof(Env) + sizeof(LObject) * (arity + c->fn->captures.count);
+                Env *frame = arena_alloc_raw(a, size, sizeof(void*));
+                int keep = arena_after_mark(a, base, c);
+
+                frame->parent = NULL;
+                memcpy(frame->slots + arity, c->captured, sizeof(LObject) * c->fn->captures.count);
+
+                for (size_t i = 0; i < arity; ++i) {
+                    frame->slots[i] = eval_expr(I, a, &f->args.items[i], in, env);
+                    if (obj_is_none(frame->slots[i])) {
+                        out = frame->slots[i];
+                        goto leave;
+                    }
+                    keep |= obj_is_ref(frame->slots[i]) && arena_after_mark(a, base, obj_ptr(frame->slots[i]));
+                }
+
+                // Frame is moved down to base, so loop runs in constant memory
+                if (!keep) {
+                    arena_rewind(a, base);
+                    Env *moved = arena_alloc_raw(a, size, sizeof(void*));
+                    memmove(moved, frame, size);
+                    frame = moved;
+                }
+
+                env = frame;
+                e = &c->fn->body;
+                continue;
+            }
+
+            default: {
+                assert(0 && "Unreachable expr type");
+            }
+        }
+    }
+
+leave:
+    eval_depth -= 1;
+    if (call) out = obj_locate(out, call->at);
+    return eval_leave(a, base, out);
+}
+
+LObject eval(Interp *I, Arena *a, Statement *s, Inputs in)
+{
+    LObject output = OBJ_NONE;
+
+    switch (s->t) {
+        // Failure outside of calls, e.g. in value of `define`, gets place of form
+        case STATEMENT_VOID: {
+            output = obj_locate(eval_expr(I, a, &s->v.e, in, NULL), s->at);
+            break;
+        }
+        default: {
+            assert(0 && "Unreachable state type");
+        }
+    }
+
+    return pool_leave(I, a, output);
+}
+
+// Evaluates statement for every of `n` inputs. Returns count of successful evaluations
+size_t eval_batch(Interp *I, Arena *a, Statement *s, Inputs *in, size_t n, LObject *out)
+{
+    size_t ok = 0;
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = eval(I, a, s, in[i]);
+        ok += !obj_is_none(out[i]);
+    }
+    return ok;
+}
+
+LObject stateval(Interp *I, Arena *a, Statement *s)
+{
+    return eval(I, a, s, INPUTS_NONE);
+}
@@ -0,0 +1,49 @@
+#ifndef EVAL_H_
+#define EVAL_H_
+
+#include "types.h"
+#include "arena.h"
+#include "arith.h"
+#include "env.h"
+
+// Values for `$N` inputs of retained tree
+typedef struct {
+    size_t count;
+    LObject *items;
+} Inputs;
+
+#define INPUTS_NONE (Inputs) {0}
+
+// Nesting of calls which evaluators and compilers go through by recursion,
+// deeper expression fails instead of overflowing C stack of thread
+#define EXPR_DEPTH_MAX 10000
+
+/*
+ * Evaluation never modifies tree, so once parsed statement
+ * can be evaluated any number of times with different inputs.
+ * Temporary values are dropped from arena before return.
+ * Failure is returned as object with `Error` in arena (see `obj_fail`),
+ * which is kept like any other result, so it's valid until form is dropped.
+ */
+// Temporaries are dropped unless result refers to them.
+// Big integers are reboxed after, because they lives in arena
+LAM_FUNC LObject eval_leave(Arena *a, Arena_Mark mark, LObject out)
+{
+    if (obj_is_boxed(out) && obj_tag(out) == NB_BIGINT) {
+        i64 x = obj_as_int(out);
+        arena_rewind(a, mark);
+        return obj_int(a, x);
+    }
+
+    if (!obj_is_ref(out) || !arena_after_mark(a, mark, obj_ptr(out))) arena_rewind(a, mark);
+    return out;
+}
+
+LAM_API LObject eval(Interp *I, Arena *a, Statement *s, Inputs in);
+LAM_API LObject eval_expr(Interp *I, Arena *a, Expr *e, Inputs in, Env *env);
+LAM_API size_t eval_batch(Interp *I, Arena *a, Statement *s, Inputs *in, size_t n, LObject *out);
+
+LAM_API LObject stateval(Interp *I, Arena *a, Statement *s);
+LAM_API LObject statfuncall(Interp *I, Arena *a, Funcall *f, Inputs in, Env *env);
+
+#endif // EVAL_H_
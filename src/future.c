@@ -0,0 +1,356 @@
+#include <sched.h>
+#include <unistd.h>
+
+#include "future.h"
+#include "interp.h"
+
+#define DEQUE_INIT_CAPACITY 64 // Must be power of two
+
+static _Thread_local Pool_Worker *current; // Set in threads of pool
+static _Thread_local size_t task_depth;    // Futures run by thread right now
+
+/*
+ * Deque
+ */
+
+LAM_FUNC void deque_init(Deque *d)
+{
+    d->capacity = DEQUE_INIT_CAPACITY;
+    d->items = malloc(sizeof(Future*) * d->capacity);
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    pthread_mutex_init(&d->lock, NULL);
+}
+
+LAM_FUNC void deque_free(Deque *d)
+{
+    free(d->items);
+    pthread_mutex_destroy(&d->lock);
+}
+
+LAM_FUNC int deque_empty(Deque *d)
+{
+    return atomic_load_explicit(&d->top, memory_order_relaxed) ==
+           atomic_load_explicit(&d->bottom, memory_order_relaxed);
+}
+
+LAM_FUNC void deque_push(Deque *d, Future *f)
+{
+    pthread_mutex_lock(&d->lock);
+    size_t top = atomic_load(&d->top), bottom = atomic_load(&d->bottom);
+
+    if (bottom - top == d->capacity) {
+        Future **items = malloc(sizeof(Future*) * d->capacity * 2);
+        for (size_t i = top; i < bottom; ++i) items[i & (d->capacity * 2 - 1)] = d->items[i & (d->capacity - 1)];
+        free(d->items);
+        d->items = items;
+        d->capacity *= 2;
+    }
+
+    d->items[bottom & (d->capacity - 1)] = f;
+    atomic_store(&d->bottom, bottom + 1);
+    pthread_mutex_unlock(&d->lock);
+}
+
+// Futures left in deque were already run by touch, returns count of them
+LAM_FUNC size_t deque_clear(Deque *d)
+{
+    pthread_mutex_lock(&d->lock);
+    size_t top = atomic_load(&d->top), bottom = atomic_load(&d->bottom);
+    atomic_store(&d->top, bottom);
+    pthread_mutex_unlock(&d->lock);
+    return bottom - top;
+}
+
+// Owner takes last pushed future, it's most likely still in cache
+LAM_FUNC Future *deque_pop(Deque *d)
+{
+    Future *f = NULL;
+    pthread_mutex_lock(&d->lock);
+    size_t bottom = atomic_load(&d->bottom);
+    if (bottom != atomic_load(&d->top)) {
+        f = d->items[(bottom - 1) & (d->capacity - 1)];
+        atomic_store(&d->bottom, bottom - 1);
+    }
+    pthread_mutex_unlock(&d->lock);
+    return f;
+}
+
+// Thief takes oldest future, which usually is the biggest part of work
+LAM_FUNC Future *deque_steal(Deque *d)
+{
+    Future *f = NULL;
+    pthread_mutex_lock(&d->lock);
+    size_t top = atomic_load(&d->top);
+    if (top != atomic_load(&d->bottom)) {
+        f = d->items[top & (d->capacity - 1)];
+        atomic_store(&d->top, top + 1);
+    }
+    pthread_mutex_unlock(&d->lock);
+    return f;
+}
+
+/*
+ * Running
+ */
+
+LAM_FUNC Pool_Worker *pool_self(Pool *p)
+{
+    return current && current->pool == p ? current : &p->workers[p->count];
+}
+
+// Future may stay in deque after it was run by touch, so it's claimed before run
+LAM_FUNC int future_claim(Future *f)
+{
+    int expected = FUTURE_PENDING;
+    return atomic_compare_exchange_strong(&f->state, &expected, FUTURE_RUNNING);
+}
+
+// Own deque is checked first, then others from next one
+LAM_FUNC Future *pool_take(Pool *p, Pool_Worker *self)
+{
+    size_t n = p->count + 1;
+    size_t start = (size_t)(self - p->workers);
+
+    for (size_t i = 0; i < n; ++i) {
+        Deque *d = &p->workers[(start + i) % n].deque;
+        while (!deque_empty(d)) {
+            Future *f = i == 0 ? deque_pop(d) : deque_steal(d);
+            if (!f) break;
+            atomic_fetch_sub(&p->queued, 1);
+            if (future_claim(f)) return f;
+        }
+    }
+
+    return NULL;
+}
+
+// Objects are copied into `a` unless they are already out of evaluation memory.
+// Closures are copied with captured values, futures are kept or replaced by values.
+// Failures are copied too, so they outlive cells of threads
+static LObject future_copy(Interp *I, Arena *a, LObject o, int resolve)
+{
+    Error *err = obj_as_error(o);
+    if (err) return obj_error(error_copy(a, err));
+
+    switch (obj_type(o)) {
+        case OBJ_TYPE_INT: {
+            return obj_int(a, obj_as_int(o));
+        }
+
+        case OBJ_TYPE_FUNC: {
+            Closure *c = obj_as_func(o);
+            size_t n = c->fn->captures.count;
+            Closure *copy = arena_alloc_raw(a, sizeof(Closure) + sizeof(LObject) * n, sizeof(void*));
+            copy->fn = c->fn;
+            for (size_t i = 0; i < n; ++i) copy->captured[i] = future_copy(I, a, c->captured[i], resolve);
+            return obj_func(copy);
+        }
+
+        case OBJ_TYPE_FUTURE: {
+            if (!resolve) return o;
+            return future_copy(I, a, future_touch(I, a, o), resolve);
+        }
+
+        default: return o;
+    }
+}
+
+// Result is copied into cells of thread, because its arena is rewound
+LAM_FUNC void future_run(Pool *p, Pool_Worker *self, Arena *a, Future *f)
+{
+    Arena_Mark mark = arena_mark(a);
+    size_t n = f->fn->captures.count;
+    Env *frame = env_new(a, NULL, n);
+    memcpy(frame->slots, f->captured, sizeof(LObject) * n);
+
+    task_depth += 1;
+    LObject out = eval_expr(p->I, a, &f->fn->body, f->in, frame);
+    f->result = future_copy(p->I, &self->cells, out, 0);
+    task_depth -= 1;
+
+    arena_rewind(a, mark);
+    atomic_store_explicit(&f->state, FUTURE_DONE, memory_order_release);
+    atomic_fetch_sub(&p->pending, 1);
+}
+
+static void *worker_run(void *arg)
+{
+    Pool_Worker *w = arg;
+    Pool *p = w->pool;
+    current = w;
+
+    for (;;) {
+        atomic_fetch_add(&p->taking, 1);
+        Future *f = pool_take(p, w);
+        atomic_fetch_sub(&p->taking, 1);
+        if (f) {
+            future_run(p, w, &w->arena, f);
+            continue;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        while (!atomic_load(&p->queued) && !p->stop) pthread_cond_wait(&p->wake, &p->lock);
+        int stop = p->stop;
+        pthread_mutex_unlock(&p->lock);
+        if (stop) break;
+    }
+
+    return NULL;
+}
+
+/*
+ * Api
+ */
+
+Pool *pool_new(Interp *I, size_t threads)
+{
+    if (!threads) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+
+    Pool *p = calloc(1, sizeof(Pool));
+    p->I = I;
+    p->count = threads - 1;
+    p->workers = calloc(threads, sizeof(Pool_Worker));
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+
+    for (size_t i = 0; i < threads; ++i) {
+        p->workers[i].pool = p;
+        deque_init(&p->workers[i].deque);
+    }
+
+    for (size_t i = 0; i < p->count; ++i) {
+        if (pthread_create(&p->workers[i].thread, NULL, worker_run, &p->workers[i]) != 0) {
+            report("Cannot start thread of pool, futures run on %zu threads", i + 1);
+            p->count = i;
+            break;
+        }
+    }
+
+    // Thread owning interpreter is last, even if some threads were not started
+    if (p->count != threads - 1) {
+        Pool_Worker owner = p->workers[threads - 1];
+        p->workers[threads - 1] = p->workers[p->count];
+        p->workers[p->count] = owner;
+    }
+
+    return p;
+}
+
+void pool_free(Pool *p)
+{
+    if (!p) return;
+
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+
+    size_t threads = p->count + 1;
+    for (size_t i = 0; i < p->count; ++i) pthread_join(p->workers[i].thread, NULL);
+    for (size_t i = 0; i < threads; ++i) {
+        deque_free(&p->workers[i].deque);
+        arena_free(&p->workers[i].arena);
+        arena_free(&p->workers[i].cells);
+    }
+
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    free(p->workers);
+    free(p);
+}
+
+// Pool is started by first future of interpreter
+LObject future_spawn(Interp *I, Lambda *fn, Inputs in, Env *env)
+{
+    if (!I->pool) I->pool = pool_new(I, I->threads);
+
+    Pool *p = I->pool;
+    Pool_Worker *self = pool_self(p);
+    size_t n = fn->captures.count;
+
+    Future *f = arena_alloc_raw(&self->cells, sizeof(Future) + sizeof(LObject) * n, sizeof(void*));
+    f->fn = fn;
+    f->in = in;
+    f->result = OBJ_NIL;
+    atomic_init(&f->state, FUTURE_PENDING);
+    for (size_t i = 0; i < n; ++i) f->captured[i] = future_copy(I, &self->cells, env_lookup(env, fn->captures.items[i]), 0);
+
+    if (self == &p->workers[p->count]) p->used = 1;
+    atomic_fetch_add(&p->pending, 1);
+    deque_push(&self->deque, f);
+    atomic_fetch_add(&p->queued, 1);
+
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+
+    return obj_future(f);
+}
+
+// Value of not future is itself
+LObject future_touch(Interp *I, Arena *a, LObject o)
+{
+    if (obj_type(o) != OBJ_TYPE_FUTURE) return o;
+
+    Future *f = obj_as_future(o);
+    Pool *p = I->pool;
+    Pool_Worker *self = pool_self(p);
+
+    if (future_claim(f)) future_run(p, self, a, f);
+
+    while (atomic_load_explicit(&f->state, memory_order_acquire) != FUTURE_DONE) {
+        Future *t = pool_take(p, self);
+        if (t) future_run(p, self, a, t);
+        else sched_yield();
+    }
+
+    // Failure is shared by every toucher, each gets own copy to give place to
+    Error *err = obj_as_error(f->result);
+    return err ? obj_error(error_copy(a, err)) : f->result;
+}
+
+int future_in_task(void)
+{
+    return task_depth > 0;
+}
+
+void pool_wait(Interp *I, Arena *a)
+{
+    Pool *p = I->pool;
+    if (!p) return;
+
+    Pool_Worker *self = pool_self(p);
+    while (atomic_load_explicit(&p->pending, memory_order_acquire) > 0) {
+        Future *t = pool_take(p, self);
+        if (t) future_run(p, self, a, t);
+        else sched_yield();
+    }
+}
+
+LObject future_resolve(Interp *I, Arena *a, LObject o)
+{
+    return future_copy(I, a, o, 1);
+}
+
+// Every thread of pool is idle after wait, so their cells are reset by owner.
+// Futures run by touch are still in deques, idle thread may take one of them
+// and check its state, so memory is reused only after nobody holds them
+LObject pool_leave(Interp *I, Arena *a, LObject out)
+{
+    Pool *p = I->pool;
+    if (!p || !p->used) return out;
+
+    pool_wait(I, a);
+    out = future_resolve(I, a, out);
+
+    for (size_t i = 0; i <= p->count; ++i) atomic_fetch_sub(&p->queued, deque_clear(&p->workers[i].deque));
+    while (atomic_load(&p->taking) > 0) sched_yield();
+
+    for (size_t i = 0; i <= p->count; ++i) arena_reset(&p->workers[i].cells);
+    p->used = 0;
+    return out;
+}
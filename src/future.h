@@ -0,0 +1,87 @@
+#ifndef FUTURE_H_
+#define FUTURE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "types.h"
+#include "arena.h"
+#include "eval.h"
+
+/*
+ * `(future expr)` evaluates expression on work-stealing pool of interpreter,
+ * `(touch f)` waits for its value. Body of future is parsed as closure
+ * without arguments, so values of free variables are copied when it's made.
+ *
+ * Every thread has own deque: spawned future is pushed to bottom of deque
+ * of its thread and popped from bottom by it, idle threads steal from top of others.
+ * Thread which touches unfinished future runs it itself if nobody took it yet,
+ * otherwise runs other futures until it's done, so touch never sleeps.
+ *
+ * Every thread evaluates in own arena. Futures and their results are kept in
+ * arena of thread which made them until end of top-level form, where every future
+ * is joined and result of form is copied out with futures replaced by their values.
+ * Futures must not change globals, so `define` inside of them fails.
+ */
+enum {
+    FUTURE_PENDING = 0,
+    FUTURE_RUNNING,
+    FUTURE_DONE,
+};
+
+struct Future {
+    Lambda *fn;       // Body and captures of future
+    Inputs in;        // Inputs of form where future was made
+    atomic_int state;
+    LObject result;   // Valid after state is FUTURE_DONE
+    LObject captured[];
+};
+
+// Futures are removed from top by thieves and from bottom by owner
+typedef struct {
+    Future **items;
+    size_t capacity;  // Power of two
+    atomic_size_t top;
+    atomic_size_t bottom;
+    pthread_mutex_t lock;
+} Deque;
+
+typedef struct {
+    Pool *pool;
+    pthread_t thread;
+    Deque deque;
+    Arena arena; // Memory of evaluation, rewound after every future
+    Arena cells; // Futures made by thread and results of futures it ran
+} Pool_Worker;
+
+struct Pool {
+    Interp *I;
+    size_t count;          // Count of threads started by pool
+    Pool_Worker *workers;  // Last one is for thread which owns interpreter
+    atomic_size_t queued;  // Futures in deques
+    atomic_size_t pending; // Futures which are not done
+    atomic_size_t taking;  // Idle threads which may hold future taken from deque
+    int used;              // Futures were made in current form
+    int stop;
+    pthread_mutex_t lock;  // Guards sleeping of idle threads
+    pthread_cond_t wake;
+};
+
+// Count of threads is count of CPUs if 0, thread owning interpreter is counted too
+LAM_API Pool *pool_new(Interp *I, size_t threads);
+LAM_API void pool_free(Pool *p);
+
+LAM_API LObject future_spawn(Interp *I, Lambda *fn, Inputs in, Env *env);
+LAM_API LObject future_touch(Interp *I, Arena *a, LObject o);
+LAM_API int future_in_task(void);
+
+// Waits for every future, `a` is used to run those nobody took yet
+LAM_API void pool_wait(Interp *I, Arena *a);
+
+// Ends top-level form: joins every future and copies result out of pool memory
+LAM_API LObject pool_leave(Interp *I, Arena *a, LObject out);
+
+// Copy of object where futures are replaced by their values
+LAM_API LObject future_resolve(Interp *I, Arena *a, LObject o);
+
+#endif // FUTURE_H_
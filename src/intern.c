@@ -0,0 +1,76 @@
+#include "intern.h"
+#include "interp.h"
+
+// FNV-1a
+u64 intern_hash(String_View sv)
+{
+    u64 h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < sv.count; ++i) {
+        h ^= (u8)sv.data[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static void intern_grow(Intern *in)
+{
+    size_t capacity = in->capacity ? in->capacity * 2 : INTERN_INIT_CAPACITY;
+    Intern_Slot *slots = arena_alloc(&in->arena, sizeof(Intern_Slot) * capacity);
+
+    for (size_t i = 0; i < in->capacity; ++i) {
+        Intern_Slot s = in->slots[i];
+        if (!s.sym) continue;
+
+        size_t j = s.hash & (capacity - 1);
+        while (slots[j].sym) j = (j + 1) & (capacity - 1);
+        slots[j] = s;
+    }
+
+    in->slots = slots;
+    in->capacity = capacity;
+}
+
+Symbol *intern_sv(Intern *in, String_View sv)
+{
+    // Load factor is kept below 0.7
+    if ((in->count + 1) * 10 > in->capacity * 7) intern_grow(in);
+
+    u64 h = intern_hash(sv);
+    size_t mask = in->capacity - 1;
+    size_t i = h & mask;
+
+    while (in->slots[i].sym) {
+        Intern_Slot *s = &in->slots[i];
+        if (s->hash == h && sv_cmp(s->sym->sv, sv)) return s->sym;
+        i = (i + 1) & mask;
+    }
+
+    Symbol *sym = arena_alloc(&in->arena, sizeof(Symbol));
+    sym->sv.data = arena_alloc_raw(&in->arena, sv.count + 1, 1);
+    memcpy(sym->sv.data, sv.data, sv.count);
+    sym->sv.data[sv.count] = '\0';
+    sym->sv.count = sv.count;
+    sym->hash = h;
+
+    in->slots[i] = (Intern_Slot) { .hash = h, .sym = sym };
+    in->count += 1;
+    return sym;
+}
+
+void intern_free(Intern *in)
+{
+    arena_free(&in->arena);
+    in->slots = NULL;
+    in->capacity = 0;
+    in->count = 0;
+}
+
+Symbol *intern(Interp *I, String_View sv)
+{
+    return intern_sv(&I->symbols, sv);
+}
+
+Symbol *intern_cstr(Interp *I, const char *cstr)
+{
+    return intern_sv(&I->symbols, sv_from_cstr((char*)cstr));
+}
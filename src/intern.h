@@ -0,0 +1,34 @@
+#ifndef INTERN_H_
+#define INTERN_H_
+
+#include "types.h"
+#include "arena.h"
+
+#define INTERN_INIT_CAPACITY 256 // Must be power of two
+
+typedef struct {
+    u64 hash;
+    Symbol *sym;
+} Intern_Slot;
+
+/*
+ * Open addressing table of unique strings.
+ * Symbols and slots are stored in own arena of table,
+ * so symbols lives until table is freed.
+ */
+typedef struct {
+    Intern_Slot *slots;
+    size_t capacity;
+    size_t count;
+    Arena arena;
+} Intern;
+
+LAM_API u64 intern_hash(String_View sv);
+LAM_API Symbol *intern_sv(Intern *in, String_View sv);
+LAM_API void intern_free(Intern *in);
+
+// Table of interpreter
+LAM_API Symbol *intern(Interp *I, String_View sv);
+LAM_API Symbol *intern_cstr(Interp *I, const char *cstr);
+
+#endif // INTERN_H_
@@ -0,0 +1,14 @@
+#include "interp.h"
+#include "future.h"
+
+// Pool is stopped first, its threads read everything else.
+// Symbols are referenced by natives and globals, so they are freed last
+void interp_free(Interp *I)
+{
+    pool_free(I->pool);
+    arena_free(&I->globals.arena);
+    arena_free(&I->natives.arena);
+    arena_free(&I->parse);
+    intern_free(&I->symbols);
+    memset(I, 0, sizeof(*I));
+}
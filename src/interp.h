@@ -0,0 +1,42 @@
+#ifndef INTERP_H_
+#define INTERP_H_
+
+#include "types.h"
+#include "intern.h"
+#include "native.h"
+#include "env.h"
+#include "arith.h"
+
+// Names of special forms
+enum {
+    KW_DEFINE = 0,
+    KW_LET,
+    KW_LAMBDA,
+    KW_IF,
+    KW_FUTURE,
+    KW_COUNT
+};
+
+/*
+ * State of one interpreter: symbols, natives and globals.
+ * Every function that touches this state gets interpreter explicitly,
+ * so separate instances can run in parallel threads without locks.
+ * Zero initialized instance is ready to use, builtins are registered on first use.
+ * Single instance must not be used by several threads at once,
+ * except futures, which only read it while pool runs them.
+ */
+struct Interp {
+    Intern symbols;
+    Natives natives;
+    Globals globals;
+    Symbol *keywords[KW_COUNT];
+    Fsum_Mode fsum;
+    Pool *pool;     // Threads of futures, started by first one
+    size_t threads; // Size of pool with thread of interpreter, count of CPUs if 0
+    Profile *prof;  // Counters of `-p`, NULL if disabled
+    Arena parse;    // Stack of parser, reused by every statement
+};
+
+LAM_API void interp_free(Interp *I);
+
+#endif // INTERP_H_
@@ -1,7 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
@@ -9,13 +12,37 @@
 #include "types.h"
 #include "lexer.h"
 #include "parser.h"
+#include "eval.h"
+#include "vm.h"
+#include "ccomp.h"
+#include "arith.h"
+#include "interp.h"
+#include "server.h"
+#include "profile.h"
 
 #define LAM_PROMPT "> "
+#define LAM_HISTORY ".lambda_history"
 
 #define line_end(l)     free((l)->data)
 #define lamrepl_usage   printf("Lambda REPL mode. To exit type \"quit\".\n")
 
-static char *hs = ".lambda_history";
+typedef struct {
+    const char **files; // Source files for batch mode. REPL if none
+    size_t nfiles;
+    size_t jobs;      // Files evaluated at once, count of CPUs if 0
+    int bytecode;     // Evaluate through bytecode VM
+    int ccomp;        // Evaluate through closure compiled tree
+    int disasm;       // Print compiled bytecode before running
+    int stats;        // Print lexer throughput after file evaluation
+    int mem_stats;    // Print arena statistics at exit
+    Fsum_Mode fsum;   // Summation mode of interpreter
+    const char *serve; // Socket path for server mode
+    size_t workers;   // Threads of server, count of CPUs if 0
+    size_t threads;   // Threads of futures, count of CPUs if 0
+    int profile;      // Print time and counters of phases at exit
+    const char *profile_json; // File for JSON line of every form
+    FILE *profile_out;
+} Options;
 
 LAM_FUNC char *shift_args(int *argc, char ***argv)
 {
@@ -28,17 +55,33 @@ LAM_FUNC char *shift_args(int *argc, char ***argv)
 LAM_FUNC void usage(const char *program)
 {
     printf("\nLambda Programming Language\n");
-    printf("    By default starting REPL mode.\n\n");
-    printf("Usage: %s [options] <file.lam>\n", program);
+    printf("    By default starting REPL mode.\n");
+    printf("    If files provided evaluates every top-level form from them.\n\n");
+    printf("Usage: %s [options] <file.lam>...\n", program);
     printf("Options:\n");
     printf("    -h    shows this usage\n");
+    printf("    -b    evaluates forms through bytecode VM\n");
+    printf("    -d    prints disassembly of compiled forms (implies -b)\n");
+    printf("    -c    evaluates forms through closure compiled tree\n");
+    printf("    -s    prints token throughput of whole evaluation and of lexer alone\n");
+    printf("    -j N  evaluates N files at once, output is printed in order of files\n");
+    printf("    -p    prints time and counters of lexer, parser, evaluator and printer at exit\n");
+    printf("    --mem-stats    prints arena statistics at exit\n");
+    printf("    --fsum=MODE    float summation: fast (default), pairwise, kahan or seq\n");
+    printf("    --serve PATH   serves evaluation requests on unix socket (see src/server.h)\n");
+    printf("    --workers=N    count of server threads, count of CPUs by default\n");
+    printf("    --threads=N    count of threads running futures, count of CPUs by default\n");
+    printf("    --profile-json=PATH  writes profile of every form as JSON line (implies -p)\n");
+    printf("REPL commands:\n");
+    printf("    :mem    prints arena statistics\n");
 }
 
 
-LAM_FUNC int cmdargs(int *argc, char ***argv)
+LAM_FUNC int cmdargs(int *argc, char ***argv, Options *opt)
 {
     int status = 1;
     const char *program = shift_args(argc, argv);
+    opt->files = calloc(*argc + 1, sizeof(*opt->files));
 
     while (*argc > 0) {
         char *flag = shift_args(argc, argv);
@@ -48,103 +91,478 @@ LAM_FUNC int cmdargs(int *argc, char ***argv)
                     usage(program);
                     defer_status(1);
                 }
+                case 'b': {
+                    opt->bytecode = 1;
+                    break;
+                }
+                case 'd': {
+                    opt->bytecode = 1;
+                    opt->disasm = 1;
+                    break;
+                }
+                case 'c': {
+                    opt->ccomp = 1;
+                    break;
+                }
+                case 's': {
+                    opt->stats = 1;
+                    break;
+                }
+                case 'p': {
+                    opt->profile = 1;
+                    break;
+                }
+                case 'j': {
+                    const char *n = flag[2] ? flag + 2 : (*argc > 0 ? shift_args(argc, argv) : "");
+                    char *end;
+                    opt->jobs = strtoul(n, &end, 10);
+                    if (end == n || *end) {
+                        report("Invalid count of jobs `%s`", n);
+                        defer_status(0);
+                    }
+                    break;
+                }
+                case '-': {
+                    if (!strcmp(flag, "--mem-stats")) {
+                        opt->mem_stats = 1;
+                        break;
+                    }
+                    if (!strncmp(flag, "--fsum=", 7)) {
+                        if (!arith_parse_fsum(flag + 7, &opt->fsum)) {
+                            report("Unknown summation mode `%s`", flag + 7);
+                            defer_status(0);
+                        }
+                        break;
+                    }
+                    if (!strcmp(flag, "--serve")) {
+                        if (*argc == 0) {
+                            report("Option `--serve` expects path of socket");
+                            defer_status(0);
+                        }
+                        opt->serve = shift_args(argc, argv);
+                        break;
+                    }
+                    if (!strncmp(flag, "--workers=", 10)) {
+                        char *end;
+                        opt->workers = strtoul(flag + 10, &end, 10);
+                        if (end == flag + 10 || *end) {
+                            report("Invalid count of workers `%s`", flag + 10);
+                            defer_status(0);
+                        }
+                        break;
+                    }
+                    if (!strncmp(flag, "--profile-json=", 15)) {
+                        opt->profile = 1;
+                        opt->profile_json = flag + 15;
+                        break;
+                    }
+                    if (!strncmp(flag, "--threads=", 10)) {
+                        char *end;
+                        opt->threads = strtoul(flag + 10, &end, 10);
+                        if (end == flag + 10 || *end) {
+                            report("Invalid count of threads `%s`", flag + 10);
+                            defer_status(0);
+                        }
+                        break;
+                    }
+                    report("Unknown option `%s`", flag);
+                    defer_status(0);
+                }
                 default: {
                     report("Unknown option `%c`", flag[1]);
                     defer_status(0);
                 }
             }
         } else {
-            report("Unknown flag `%s`", flag);
-            defer_status(0);
+            opt->files[opt->nfiles++] = flag;
         }
     }
 
+    // Disassembly is printed to stdout by VM, so it cannot be collected per file
+    if (opt->disasm && opt->nfiles > 1) {
+        report("Option `-d` cannot be used for several files");
+        defer_status(0);
+    }
+
 defer:
     return status;
 }
 
 LAM_FUNC String_View slurp_line(const char *prompt)
 {
-    static int isread;
-    if (!isread) {
-        read_history(hs);
-        isread = 1;
-    }
-
     char *line = readline(prompt);
     if (!line) return (String_View) {0};
     
     add_history(line);
-    append_history(1, hs);
+    append_history(1, LAM_HISTORY);
     return sv_from_cstr(line);
 }
 
-LAM_FUNC int print_obj(LObject *o)
+LAM_FUNC int print_obj(FILE *out, LObject *o)
 {
-    switch (o->t) {
+    switch (obj_type(*o)) {
         case OBJ_TYPE_NIL:
-            printf("nil");
+            fprintf(out, "nil");
             break;
 
         case OBJ_TYPE_INT:
-            printf("%lli", o->v.i);
+            fprintf(out, "%lli", obj_as_int(*o));
             break;
 
         case OBJ_TYPE_FLT:
-            printf("%lf", o->v.f);
+            fprintf(out, "%lf", obj_as_flt(*o));
             break;
 
         case OBJ_TYPE_BOOLEAN:
-            printf("%s", o->v.b == 1 ? "True" : "False");
+            fprintf(out, "%s", obj_as_bool(*o) ? "True" : "False");
             break;
 
         case OBJ_TYPE_STR:
-            printf(SV_Fmt, (int)o->v.s->count, o->v.s->data);
+            fprintf(out, SV_Fmt, SV_Args(*obj_as_str(*o)));
+            break;
+
+        case OBJ_TYPE_FUNC:
+            fprintf(out, "<lambda/%u>", obj_as_func(*o)->fn->arity);
             break;
 
         default:
-            report("Unknown object type %u\n", o->t);
+            report("Unknown object type %u\n", obj_type(*o));
             return 0;          
     }
 
-    printf("\n");
+    fprintf(out, "\n");
     return 1;
 }
 
-LAM_FUNC void repl(String_View line)
+// Value is printed, or error with place of failed call. Returns if evaluation didn't fail
+LAM_FUNC int evalprint(Interp *I, Arena *a, Statement *s, Options *opt, FILE *out)
 {
-    Arena a = {0};
-    Lexer lex = lexer_new(NULL, line);
-    Statement s = parse_statement(&a, &lex);
+    LObject o = OBJ_NIL;
+    u64 t = I->prof ? prof_now() : 0;
 
-    if (s.t != STATEMENT_NONE) {
-        Expr expr = stateval(&a, &s);
-        LObject o = obj_from_atom(&a, expr.v.a);
-        print_obj(&o);
+    if (opt->bytecode) {
+        // Forms VM can't run yet are evaluated by walker, like subtrees of `-c`
+        Chunk c = {0};
+        switch (compile_statement(I, a, &c, s, &o)) {
+            case COMPILE_OK:
+                if (opt->disasm) chunk_disasm(&c);
+                o = vm_run(I, a, &c);
+                break;
+            case COMPILE_WALK: o = stateval(I, a, s); break;
+            case COMPILE_FAIL: break;
+        }
+    } else if (opt->ccomp) {
+        o = ccomp_run(I, a, ccomp_statement(I, a, s), INPUTS_NONE);
+    } else {
+        o = stateval(I, a, s);
     }
+
+    if (I->prof) t = prof_lap(I->prof, PROF_EVAL, t);
+    if (obj_is_none(o)) {
+        Error *err = obj_as_error(o);
+        if (err) error_dump(err);
+        return 0;
+    }
+
+    print_obj(out, &o);
+    if (I->prof) prof_lap(I->prof, PROF_PRINT, t);
+    return 1;
+}
+
+// Arena is shared between lines, everything allocated for line is dropped after it
+LAM_FUNC void repl(Interp *I, Arena *a, String_View line, Options *opt)
+{
+    Arena_Mark mark = arena_mark(a);
+    Lexer lex = lexer_new(NULL, line);
+    lex.prof = I->prof;
+
+    Prof_Form pf;
+    if (I->prof) prof_form_begin(I->prof, &pf, &lex, a);
+    Statement s = parse_statement(I, a, &lex);
+    if (I->prof) prof_form_parsed(I->prof, &pf, &s);
+
+    if (s.t == STATEMENT_ERROR) error_dump(s.v.err);
+    else evalprint(I, a, &s, opt, stdout);
     
-    arena_free(&a);
+    if (I->prof) prof_form_end(I->prof, &pf, &lex, a);
+    arena_rewind(a, mark);
+}
+
+// Seconds passed from `start` to `end` of monotonic clock
+LAM_FUNC double secs_between(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Scans source once more without parser and evaluator, so rate of lexer is not hidden by them
+LAM_FUNC double lex_only(const char *file_path, String_View src, size_t *tokens)
+{
+    struct timespec start, end;
+    Lexer lex = lexer_new(file_path, src);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (lexer_next(&lex).type != TK_NONE) {}
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *tokens = lex.ntokens;
+    return secs_between(start, end);
+}
+
+// Evaluates every top-level form of mapped file.
+// One lexer walks the whole buffer and arena is rewound after every form.
+// Form which cannot be parsed is reported and skipped, status tells if there were any
+// such forms or forms which failed to evaluate. Failed form never stops the file
+LAM_FUNC int lamfile(Interp *I, Arena *a, const char *file_path, Options *opt, FILE *out)
+{
+    int status = 1;
+    String_View src = sv_map_file(file_path);
+    if (!src.data) return 0;
+
+    Arena_Mark mark = arena_mark(a);
+    Lexer lex = lexer_new(file_path, src);
+    lex.prof = I->prof;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (;;) {
+        Prof_Form pf;
+        if (I->prof) prof_form_begin(I->prof, &pf, &lex, a);
+        if (lexer_peek(&lex).type == TK_NONE) break;
+
+        Statement s = parse_statement(I, a, &lex);
+        if (I->prof) prof_form_parsed(I->prof, &pf, &s);
+
+        if (s.t == STATEMENT_ERROR) {
+            error_dump(s.v.err);
+            status = 0;
+        } else if (!evalprint(I, a, &s, opt, out)) {
+            status = 0;
+        }
+
+        if (I->prof) prof_form_end(I->prof, &pf, &lex, a);
+        arena_rewind(a, mark);
+    }
+
+    if (opt->stats) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double secs = secs_between(start, end);
+        size_t lex_tokens;
+        double lex_secs = lex_only(file_path, src, &lex_tokens);
+        fprintf(report_stream(), "end-to-end: %zu tokens, %zu bytes in %.6lf sec: %.0lf tokens/sec, %.2lf MB/sec\n",
+                lex.ntokens, src.count, secs,
+                lex.ntokens / secs, src.count / secs / (1024.0 * 1024.0));
+        fprintf(report_stream(), "lexer only: %zu tokens, %zu bytes in %.6lf sec: %.0lf tokens/sec, %.2lf MB/sec\n",
+                lex_tokens, src.count, lex_secs,
+                lex_tokens / lex_secs, src.count / lex_secs / (1024.0 * 1024.0));
+        fprintf(report_stream(), "arithmetic kernels: %s\n", arith_isa());
+    }
+
+    sv_unmap_file(src);
+    return status;
+}
+
+// Every file gets fresh interpreter, so files never see definitions of each other
+LAM_FUNC int lamfile_isolated(Arena *a, const char *file_path, Options *opt, FILE *out, Profile *prof)
+{
+    Interp I = { .fsum = opt->fsum, .threads = opt->threads, .prof = prof };
+    int ok = lamfile(&I, a, file_path, opt, out);
+    interp_free(&I);
+    return ok;
+}
+
+/*
+ * Several files at once
+ */
+
+typedef struct {
+    const char *path;
+    char *out, *err; // Collected stdout and stderr of file
+    size_t out_len, err_len;
+    Profile prof;    // Merged into profile of batch in order of files
+    int ok;
+    int done;
+} Lam_Job;
+
+typedef struct {
+    Options *opt;
+    Lam_Job *jobs;
+    atomic_size_t next;    // First job nobody took yet
+    pthread_mutex_t lock;  // Guards `done` of jobs
+    pthread_cond_t finished;
+} Lam_Batch;
+
+// Arena of runner is reused by all files it takes
+typedef struct {
+    pthread_t thread;
+    Lam_Batch *batch;
+    Arena arena;
+} Lam_Runner;
+
+static void *lamrunner(void *arg)
+{
+    Lam_Runner *r = arg;
+    Lam_Batch *b = r->batch;
+
+    for (;;) {
+        size_t i = atomic_fetch_add(&b->next, 1);
+        if (i >= b->opt->nfiles) break;
+
+        Lam_Job *job = &b->jobs[i];
+        FILE *out = open_memstream(&job->out, &job->out_len);
+        FILE *err = open_memstream(&job->err, &job->err_len);
+
+        job->prof.json = b->opt->profile_out;
+        report_redirect(err);
+        job->ok = lamfile_isolated(&r->arena, job->path, b->opt, out, b->opt->profile ? &job->prof : NULL);
+        report_redirect(NULL);
+        fclose(out);
+        fclose(err);
+
+        pthread_mutex_lock(&b->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&b->finished);
+        pthread_mutex_unlock(&b->lock);
+    }
+
+    return NULL;
+}
+
+// Files are taken by runners in order of arguments. Output of file is printed
+// as soon as all files before are done: its stdout and then its stderr,
+// so it doesn't depend on count of jobs. Futures of file run on its runner, unless `--threads` is set
+LAM_FUNC int lamfiles(Options *opt, Profile *prof)
+{
+    int ok = 1;
+    size_t jobs = opt->jobs;
+    if (!jobs) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (jobs > opt->nfiles) jobs = opt->nfiles;
+
+    // Single file is printed while it runs
+    if (opt->nfiles == 1) {
+        Arena a = {0};
+        ok = lamfile_isolated(&a, opt->files[0], opt, stdout, prof);
+        if (opt->mem_stats) arena_stats_dump(&a);
+        arena_free(&a);
+        return ok;
+    }
+
+    if (!opt->threads) opt->threads = 1;
+
+    Lam_Batch b = { .opt = opt, .jobs = calloc(opt->nfiles, sizeof(Lam_Job)) };
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.finished, NULL);
+    for (size_t i = 0; i < opt->nfiles; ++i) b.jobs[i].path = opt->files[i];
+
+    Lam_Runner *runners = calloc(jobs, sizeof(Lam_Runner));
+    size_t started = 0;
+    for (; started < jobs; ++started) {
+        runners[started].batch = &b;
+        if (pthread_create(&runners[started].thread, NULL, lamrunner, &runners[started]) != 0) break;
+    }
+
+    if (!started) {
+        report("Cannot start threads for files");
+        ok = 0;
+        goto defer;
+    }
+
+    for (size_t i = 0; i < opt->nfiles; ++i) {
+        Lam_Job *job = &b.jobs[i];
+        pthread_mutex_lock(&b.lock);
+        while (!job->done) pthread_cond_wait(&b.finished, &b.lock);
+        pthread_mutex_unlock(&b.lock);
+
+        fwrite(job->out, 1, job->out_len, stdout);
+        fflush(stdout);
+        fwrite(job->err, 1, job->err_len, stderr);
+        free(job->out);
+        free(job->err);
+        if (prof) prof_merge(prof, &job->prof);
+        ok &= job->ok;
+    }
+
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(runners[i].thread, NULL);
+        if (opt->mem_stats) arena_stats_dump(&runners[i].arena);
+        arena_free(&runners[i].arena);
+    }
+
+defer:
+    pthread_mutex_destroy(&b.lock);
+    pthread_cond_destroy(&b.finished);
+    free(runners);
+    free(b.jobs);
+    return ok;
 }
 
 int main(int argc, char **argv)
 {
-    if (!cmdargs(&argc, &argv))
+    Options opt = {0};
+    if (!cmdargs(&argc, &argv, &opt))
         return EXIT_FAILURE;
 
+    if (opt.serve) {
+        Serve_Opts so = { .path = opt.serve, .workers = opt.workers, .fsum = opt.fsum, .ccomp = opt.ccomp };
+        return serve(&so) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    Profile prof = {0};
+    if (opt.profile_json) {
+        opt.profile_out = fopen(opt.profile_json, "w");
+        if (!opt.profile_out) {
+            report("Cannot open `%s`: %s", opt.profile_json, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        prof.json = opt.profile_out;
+    }
+
+    if (opt.nfiles) {
+        int ok = lamfiles(&opt, opt.profile ? &prof : NULL);
+        if (opt.profile) prof_dump(&prof, stderr);
+        if (opt.profile_out) fclose(opt.profile_out);
+        free(opt.files);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    Interp I = { .fsum = opt.fsum, .threads = opt.threads, .prof = opt.profile ? &prof : NULL };
     lamrepl_usage;
+    read_history(LAM_HISTORY);
+
+    int status = EXIT_SUCCESS;
+    Arena a = {0};
 
     while (1) {
         String_View line = slurp_line(LAM_PROMPT);
-        if (!line.data) return EXIT_FAILURE;
+        if (!line.data) {
+            status = EXIT_FAILURE;
+            break;
+        }
 
         if (sv_cmp(line, sv_from_cstr("quit"))) {
             line_end(&line);
             break;
         }
 
-        repl(line);
+        if (sv_cmp(line, sv_from_cstr(":mem"))) {
+            arena_dump(&a);
+            arena_stats_dump(&a);
+            line_end(&line);
+            continue;
+        }
+
+        repl(&I, &a, line, &opt);
         line_end(&line);
     }
 
-    return EXIT_SUCCESS;
+    if (opt.mem_stats) arena_stats_dump(&a);
+    if (opt.profile) prof_dump(&prof, stderr);
+    if (opt.profile_out) fclose(opt.profile_out);
+    arena_free(&a);
+    interp_free(&I);
+    free(opt.files);
+    return status;
 }
@@ -1,4 +1,6 @@
+#include <assert.h>
 #include "lexer.h"
+#include "profile.h"
 
 Lexer lexer_new(const char *file_path, String_View src)
 {
@@ -13,158 +15,218 @@ Lexer lexer_new(const char *file_path, String_View src)
     return L; 
 }
 
-static inline void lexer_comments(String_View *src)
+/*
+ * Scanner is driven by class of byte. Class of first byte
+ * selects kind of token, classes of next bytes decides where token ends.
+ */
+typedef enum {
+    CC_OTHER = 0,
+    CC_END,      // Nul terminator
+    CC_SPACE,
+    CC_NEWLINE,
+    CC_COMMENT,  // From `;` until end of line
+    CC_DIGIT,
+    CC_DOT,
+    CC_IDENT,    // Letters, `_` and `$`
+    CC_OPERATOR,
+    CC_OPEN,
+    CC_CLOSE,
+    CC_QUOTE,
+} Char_Class;
+
+static const u8 char_class[256] = {
+    ['\0'] = CC_END,
+    [' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\r'] = CC_SPACE,
+    ['\v'] = CC_SPACE, ['\f'] = CC_SPACE,
+    ['\n'] = CC_NEWLINE,
+    [';'] = CC_COMMENT,
+    ['0' ... '9'] = CC_DIGIT,
+    ['.'] = CC_DOT,
+    ['a' ... 'z'] = CC_IDENT, ['A' ... 'Z'] = CC_IDENT,
+    ['_'] = CC_IDENT, ['$'] = CC_IDENT,
+    ['+'] = CC_OPERATOR, ['-'] = CC_OPERATOR, ['*'] = CC_OPERATOR,
+    ['/'] = CC_OPERATOR, ['^'] = CC_OPERATOR, ['%'] = CC_OPERATOR,
+    ['<'] = CC_OPERATOR, ['>'] = CC_OPERATOR, ['='] = CC_OPERATOR,
+    ['('] = CC_OPEN,
+    [')'] = CC_CLOSE,
+    ['"'] = CC_QUOTE, ['\''] = CC_QUOTE,
+};
+
+#define cclass(c) char_class[(u8)(c)]
+
+// Classifies next token from source. Every byte is scanned once
+static Token lexer_scan(Lexer *L)
 {
-    size_t i = 0;
-    sv_cut_left(src, 1);
-
-    while (i < src->count &&
-            src->data[i] != '\n') ++i;
-    
-    sv_cut_left(src, i);
-}
-
-static inline String_View lexer_string(String_View *src)
-{
-    size_t i = 0;
-    sv_cut_left(src, 1);
-
-    while ((src->data[i] != '"' && src->data[i] != '\'') &&
-           (i < src->count)) ++i;
-    
-    String_View result = sv_from_parts(src->data, i);
-    sv_cut_left(src, i + 1);
-
-    return result;
-}
+    Token tk = TOKEN_NONE;
+    char *p = L->src.data;
+    char *end = p + L->src.count;
 
-static inline void lexer_space(Lexer *L)
-{
-    size_t i = 0;
+    // Skip spaces and comments
+    for (; p < end; ++p) {
+        u8 c = cclass(*p);
+        if (c == CC_SPACE) continue;
 
-    while (i < L->src.count && isspace(L->src.data[i])) {
-        if (L->src.data[i] == '\n') {
-            L->linestart = L->src.data + 1;
+        if (c == CC_NEWLINE) {
+            L->linestart = p + 1;
             L->linenumber += 1;
+            continue;
         }
-        ++i;
-    }
 
-    sv_cut_left(&L->src, i);
-}
-
-static inline int lexer_char(String_View *src, Token *tk)
-{
-    int status = 1;
-    size_t shift = 1;
-
-    switch (src->data[0]) {
-        case '+':
-        case '-':
-        case '*':
-        case '/':
-        case '^':
-        case '%': {
-            tk->type = TK_OPERATOR;
-            break;
+        if (c == CC_COMMENT) {
+            char *nl = memchr(p, '\n', end - p);
+            p = (nl ? nl : end) - 1;
+            continue;
         }
 
-        case ';': {
-            lexer_comments(src);
-            status = -1;
-            shift = 0;
-            break;
-        }
+        break;
+    }
+
+    if (p >= end) {
+        L->status = LEXSTATUS_EMPTY;
+        L->src = sv_from_parts(end, 0);
+        return tk;
+    }
+
+    tk.row = L->linenumber;
+    tk.col = (size_t)(p - L->linestart) + 1;
+    char *start = p;
 
-        case '(': {
-            tk->type = TK_OPEN_PAREN;
+    switch (cclass(*p)) {
+        case CC_DIGIT: {
+            do ++p; while (p < end && (cclass(*p) == CC_DIGIT || cclass(*p) == CC_DOT));
+            tk.type = TK_NUMBER;
             break;
         }
 
-        case ')': {
-            tk->type = TK_CLOSE_PAREN;
+        case CC_IDENT: {
+            do ++p; while (p < end && (cclass(*p) == CC_IDENT || cclass(*p) == CC_DIGIT));
+            tk.type = TK_TEXT;
             break;
         }
 
-        case '\'':
-        case '"': {
-            tk->type = TK_STRING;
-            tk->text = lexer_string(src);
-            shift = 0;
-            break;
+        case CC_OPERATOR: tk.type = TK_OPERATOR; ++p; break;
+        case CC_OPEN: tk.type = TK_OPEN_PAREN; ++p; break;
+        case CC_CLOSE: tk.type = TK_CLOSE_PAREN; ++p; break;
+
+        case CC_QUOTE: {
+            start = ++p;
+            while (p < end && cclass(*p) != CC_QUOTE) ++p;
+            tk.type = TK_STRING;
+            tk.text = sv_from_parts(start, p - start);
+            if (p < end) ++p;
+            goto defer;
         }
 
-        case '\000': {
-            status = -1;
-            shift = 0;
-            break;
+        case CC_END: {
+            // Nul byte ends source as well
+            return tk;
         }
 
         default: {
-            status = 0;
-            shift = 0;
+            // Unknown byte becomes text so parser can report it
+            tk.type = TK_TEXT;
+            ++p;
             break;
         }
     }
-    
-    if (shift == 1) {
-        tk->text = sv_from_parts(src->data, 1);
-        sv_cut_left(src, shift);
-    }
 
-    return status;
+    tk.text = sv_from_parts(start, p - start);
+
+defer:
+    L->src = sv_from_parts(p, end - p);
+    L->ntokens += 1;
+    return tk;
+}
+
+static Token lexer_scan_profiled(Lexer *L)
+{
+    u64 start = prof_now();
+    Token tk = lexer_scan(L);
+    prof_lap(L->prof, PROF_LEX, start);
+    return tk;
 }
 
+#define lexer_take(L) ((L)->prof ? lexer_scan_profiled(L) : lexer_scan(L))
+
 Token lexer_next(Lexer *L)
 {
-    Token tk = TOKEN_NONE;
-    if (L->src.count <= 0) {
-        L->status = LEXSTATUS_EMPTY;
-        goto defer;
-    }
+    if (L->ahead_count == 0)
+        return lexer_take(L);
 
-    lexer_space(L);
-    
-    tk.row = L->linenumber;
-    tk.col = (size_t)(L->src.data - L->linestart) + 1;
+    Token tk = L->ahead[L->ahead_pos];
+    L->ahead_pos = (L->ahead_pos + 1) & (LEXER_LOOKAHEAD - 1);
+    L->ahead_count -= 1;
+    return tk;
+}
 
-    if (L->src.count > 0) {
-        if (isdigit(L->src.data[0])) {
-            tk.text = sv_cut_value(&L->src);
-            tk.type = TK_NUMBER;
+// Returns token that `n + 1` calls of `lexer_next` would return
+Token lexer_peek_nth(Lexer *L, size_t n)
+{
+    assert(n < LEXER_LOOKAHEAD && "Lookahead is too far");
 
-        } else {
-            if (!lexer_char(&L->src, &tk)) {
-                tk.text = sv_cut_txt(&L->src);
-                tk.type = TK_TEXT;
-            }
-        }
+    while (L->ahead_count <= n) {
+        size_t i = (L->ahead_pos + L->ahead_count) & (LEXER_LOOKAHEAD - 1);
+        L->ahead[i] = lexer_take(L);
+        L->ahead_count += 1;
     }
 
-defer:
-    return tk;
+    return L->ahead[(L->ahead_pos + n) & (LEXER_LOOKAHEAD - 1)];
 }
 
 Token lexer_peek(Lexer *L)
 {
-    Lexer copy = *L;
-    Token tk = lexer_next(L);
-    *L = copy;
-    return tk;
+    return lexer_peek_nth(L, 0);
 }
 
 Token lexer_yield(Lexer *L, Token_Type t)
 {
     Token tk = lexer_next(L);
 
-    if (tk.type != t) {
-        fprintf(stderr, "Expected %u, but provided %u\n", t, tk.type);
-        L->status = LEXSTATUS_ERR;
-    }
-
+    if (tk.type != t) L->status = LEXSTATUS_ERR;
     return tk;
 }
 
+// Moves lexer past form which begins from `open` paren, or to end of source
+// if form is not closed. Used only after error, so depth of parens is not
+// tracked while parsing but form is scanned again from its beginning
+void lexer_skip_form(Lexer *L, Token open)
+{
+    char *end = L->src.data + L->src.count;
+    Lexer skip = *L;
+
+    skip.src = sv_from_parts(open.text.data, end - open.text.data);
+    skip.linenumber = open.row;
+    skip.linestart = open.text.data - (open.col - 1);
+    skip.status = LEXSTATUS_OK;
+    skip.ahead_count = 0;
+
+    size_t depth = 0;
+    do {
+        Token tk = lexer_scan(&skip);
+        if (tk.type == TK_NONE) break;
+        if (tk.type == TK_OPEN_PAREN) depth += 1;
+        if (tk.type == TK_CLOSE_PAREN) depth -= 1;
+    } while (depth > 0);
+
+    skip.ntokens = L->ntokens;
+    *L = skip;
+}
+
+const char *token_name(Token_Type t)
+{
+    switch (t) {
+        case TK_NONE: return "end of input";
+        case TK_NIL: return "nil";
+        case TK_TEXT: return "name";
+        case TK_NUMBER: return "number";
+        case TK_STRING: return "string";
+        case TK_OPERATOR: return "operator";
+        case TK_OPEN_PAREN: return "`(`";
+        case TK_CLOSE_PAREN: return "`)`";
+        default: return "unknown token";
+    }
+}
+
 void token_dump(Token tk)
 {
     printf("[row: %zu, col: %zu] ", tk.row, tk.col);
@@ -198,8 +260,8 @@ void token_dump(Token tk)
         }
 
         default: {
-            fprintf(stderr, "Unknown token type %u\n", tk.type);
-            exit(1);
+            printf("%s", token_name(tk.type));
+            break;
         }
     }
 
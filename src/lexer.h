@@ -26,12 +26,20 @@ typedef struct {
 #define TOKEN_NIL (Token) { .type = TK_NIL }
 #define TOKEN_NONE (Token) {0}
 
+// Size of lookahead ring. Must be power of two
+#define LEXER_LOOKAHEAD 4
+
 typedef struct {
-    int status;        // Used for yielding tokens
-    size_t linenumber; // Number of current line
-    String_View src;   // Source code
-    char *linestart;   // Start of current line
-    const char *file;  // From what file
+    int status;                   // Used for yielding tokens
+    size_t linenumber;            // Number of current line
+    String_View src;              // Source code
+    char *linestart;              // Start of current line
+    const char *file;             // From what file
+    Token ahead[LEXER_LOOKAHEAD]; // Scanned but not consumed tokens
+    size_t ahead_pos;             // Index of first token in ring
+    size_t ahead_count;           // Count of tokens in ring
+    size_t ntokens;               // Count of scanned tokens
+    Profile *prof;                // Time of scanning is counted if not NULL
 } Lexer;
 
 #define LEXSTATUS_OK 1
@@ -45,8 +53,12 @@ LAM_API Lexer lexer_new(const char *file_path, String_View src);
 
 LAM_API Token lexer_next(Lexer *L);
 LAM_API Token lexer_peek(Lexer *L);
+LAM_API Token lexer_peek_nth(Lexer *L, size_t n);
 LAM_API Token lexer_yield(Lexer *L, Token_Type t);
 
+LAM_API void lexer_skip_form(Lexer *L, Token open);
+
+LAM_API const char *token_name(Token_Type t);
 LAM_API void token_dump(Token tk);
 LAM_API void lexer_dump(Lexer lex);
 
@@ -0,0 +1,88 @@
+#include "liblambda.h"
+#include "lexer.h"
+#include "parser.h"
+#include "eval.h"
+#include "interp.h"
+
+struct Lam_Ctx {
+    Interp interp;
+    Arena arena;
+    Lexer lex;
+    size_t forms;
+    Error *err;
+};
+
+Lam_Ctx *lam_ctx_new(void)
+{
+    Lam_Ctx *ctx = calloc(1, sizeof(Lam_Ctx));
+    return ctx;
+}
+
+// Regions of arena are kept for next evaluations
+void lam_ctx_reset(Lam_Ctx *ctx)
+{
+    arena_reset(&ctx->arena);
+    ctx->lex = (Lexer) {0};
+    ctx->forms = 0;
+    ctx->err = NULL;
+}
+
+void lam_ctx_free(Lam_Ctx *ctx)
+{
+    if (!ctx) return;
+    arena_free(&ctx->arena);
+    interp_free(&ctx->interp);
+    free(ctx);
+}
+
+// Memory of every form is dropped before next one, so only tree
+// and value of last form are left in arena. Evaluation stops on form
+// which cannot be parsed or evaluated, its error is kept until next call
+LObject lam_eval_sv(Lam_Ctx *ctx, String_View src)
+{
+    LObject out = OBJ_NIL;
+    Arena_Mark mark = arena_mark(&ctx->arena);
+
+    ctx->lex = lexer_new(NULL, src);
+    ctx->forms = 0;
+    ctx->err = NULL;
+
+    while (lexer_peek(&ctx->lex).type != TK_NONE) {
+        arena_rewind(&ctx->arena, mark);
+
+        Statement s = parse_statement(&ctx->interp, &ctx->arena, &ctx->lex);
+        if (s.t == STATEMENT_ERROR) {
+            ctx->err = s.v.err;
+            return obj_error(s.v.err);
+        }
+
+        out = stateval(&ctx->interp, &ctx->arena, &s);
+        ctx->forms += 1;
+        if (obj_is_none(out)) {
+            ctx->err = obj_as_error(out);
+            break;
+        }
+    }
+
+    return out;
+}
+
+LObject lam_eval_cstr(Lam_Ctx *ctx, const char *src)
+{
+    return lam_eval_sv(ctx, sv_from_cstr((char*)src));
+}
+
+size_t lam_forms(Lam_Ctx *ctx)
+{
+    return ctx->forms;
+}
+
+const Error *lam_error(Lam_Ctx *ctx)
+{
+    return ctx->err;
+}
+
+Interp *lam_interp(Lam_Ctx *ctx)
+{
+    return &ctx->interp;
+}
@@ -0,0 +1,46 @@
+#ifndef LIBLAMBDA_H_
+#define LIBLAMBDA_H_
+
+#include "types.h"
+#include "sv.h"
+
+/*
+ * Embedding api. Context owns interpreter, its arena and lexer,
+ * so source can be evaluated in process without spawning `bin/lambda`.
+ * Contexts share no state: each can be used by its own thread.
+ * Results are valid until `lam_ctx_reset` or `lam_ctx_free`.
+ * Globals and natives survive `lam_ctx_reset`.
+ */
+typedef struct Lam_Ctx Lam_Ctx;
+
+LAM_API Lam_Ctx *lam_ctx_new(void);
+LAM_API void lam_ctx_reset(Lam_Ctx *ctx);
+LAM_API void lam_ctx_free(Lam_Ctx *ctx);
+
+// Evaluates every form of source and returns value of last one.
+// OBJ_NONE is returned if some form cannot be parsed or evaluated
+LAM_API LObject lam_eval_sv(Lam_Ctx *ctx, String_View src);
+LAM_API LObject lam_eval_cstr(Lam_Ctx *ctx, const char *src);
+
+// Count of forms evaluated by last call
+LAM_API size_t lam_forms(Lam_Ctx *ctx);
+
+// Error of form which cannot be parsed or evaluated by last call, with its row and column.
+// NULL if every form succeeded
+LAM_API const Error *lam_error(Lam_Ctx *ctx);
+
+// Interpreter of context, e.g. for `lam_register_native`
+LAM_API Interp *lam_interp(Lam_Ctx *ctx);
+
+/*
+ * Accessors of result
+ */
+
+LAM_FUNC int lam_is_error(LObject o) { return obj_is_none(o); }
+LAM_FUNC LObj_Type lam_type(LObject o) { return obj_type(o); }
+LAM_FUNC i64 lam_as_int(LObject o) { return obj_as_int(o); }
+LAM_FUNC double lam_as_flt(LObject o) { return obj_as_flt(o); }
+LAM_FUNC int lam_as_bool(LObject o) { return obj_as_bool(o); }
+LAM_FUNC String_View lam_as_str(LObject o) { return *obj_as_str(o); }
+
+#endif // LIBLAMBDA_H_
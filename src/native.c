@@ -0,0 +1,214 @@
+#include "native.h"
+#include "intern.h"
+#include "interp.h"
+#include "future.h"
+#include "profile.h"
+
+static void natives_grow(Natives *r)
+{
+    size_t capacity = r->capacity ? r->capacity * 2 : NATIVES_INIT_CAPACITY;
+    Native_Slot *slots = arena_alloc(&r->arena, sizeof(Native_Slot) * capacity);
+
+    for (size_t i = 0; i < r->capacity; ++i) {
+        Native_Slot s = r->slots[i];
+        if (!s.name) continue;
+
+        size_t j = s.name->hash & (capacity - 1);
+        while (slots[j].name) j = (j + 1) & (capacity - 1);
+        slots[j] = s;
+    }
+
+    r->slots = slots;
+    r->capacity = capacity;
+}
+
+static Native_Slot *natives_slot(Natives *r, Symbol *name)
+{
+    size_t mask = r->capacity - 1;
+    size_t i = name->hash & mask;
+    while (r->slots[i].name && r->slots[i].name != name) i = (i + 1) & mask;
+    return &r->slots[i];
+}
+
+static Native *natives_put(Natives *r, Symbol *name)
+{
+    if ((r->count + 1) * 10 > r->capacity * 7) natives_grow(r);
+
+    Native_Slot *s = natives_slot(r, name);
+    if (!s->name) {
+        s->name = name;
+        s->native = arena_alloc(&r->arena, sizeof(Native));
+        r->count += 1;
+    }
+
+    return s->native;
+}
+
+/*
+ * Builtins
+ */
+
+// Arguments are unboxed in place into contiguous typed buffer.
+// Type of result is defined by first argument, rest casts to it
+static LObject native_arith(Interp *I, Arena *a, Arith_Op op, LObject *args, size_t count)
+{
+    LValue *vals = (LValue*)args;
+    LObj_Type t = obj_type(args[0]);
+
+    for (size_t i = 0; i < count; ++i) {
+        LObject x = args[i];
+        if (obj_type(x) == OBJ_TYPE_INT) {
+            if (t == OBJ_TYPE_INT) vals[i].i = obj_as_int(x);
+            else vals[i].f = (double)obj_as_int(x);
+        } else {
+            if (t == OBJ_TYPE_FLT) vals[i].f = obj_as_flt(x);
+            else vals[i].i = (i64)obj_as_flt(x);
+        }
+    }
+
+    if (t == OBJ_TYPE_INT && op == ARITH_DIV) {
+        i64 q;
+        const char *why = arith_idiv(&vals[0].i, count, &q);
+        if (why) return obj_fail(a, "%s", why);
+        return obj_int(a, q);
+    }
+
+    if (t == OBJ_TYPE_INT) return obj_int(a, arith_ireduce(op, &vals[0].i, count));
+    return obj_flt(arith_freduce(op, &vals[0].f, count, I->fsum));
+}
+
+static LObject native_add(Interp *I, Arena *a, LObject *args, size_t count) { return native_arith(I, a, ARITH_ADD, args, count); }
+static LObject native_sub(Interp *I, Arena *a, LObject *args, size_t count) { return native_arith(I, a, ARITH_SUB, args, count); }
+static LObject native_mul(Interp *I, Arena *a, LObject *args, size_t count) { return native_arith(I, a, ARITH_MUL, args, count); }
+static LObject native_div(Interp *I, Arena *a, LObject *args, size_t count) { return native_arith(I, a, ARITH_DIV, args, count); }
+
+typedef enum {
+    CMP_EQ = 0,
+    CMP_LT,
+    CMP_GT,
+} Cmp_Op;
+
+// Chained comparison: `(< a b c)` is `a < b && b < c`.
+// Integers are compared exactly, mixed pairs as floats
+static LObject native_cmp(Cmp_Op op, LObject *args, size_t count)
+{
+    for (size_t i = 0; i + 1 < count; ++i) {
+        LObject x = args[i], y = args[i + 1];
+        int c;
+
+        if (obj_type(x) == OBJ_TYPE_INT && obj_type(y) == OBJ_TYPE_INT) {
+            i64 l = obj_as_int(x), r = obj_as_int(y);
+            c = (l > r) - (l < r);
+        } else {
+            double l = obj_type(x) == OBJ_TYPE_INT ? (double)obj_as_int(x) : obj_as_flt(x);
+            double r = obj_type(y) == OBJ_TYPE_INT ? (double)obj_as_int(y) : obj_as_flt(y);
+            if (l != l || r != r) return obj_bool(0);
+            c = (l > r) - (l < r);
+        }
+
+        switch (op) {
+            case CMP_EQ: if (c != 0) return obj_bool(0); break;
+            case CMP_LT: if (c >= 0) return obj_bool(0); break;
+            case CMP_GT: if (c <= 0) return obj_bool(0); break;
+        }
+    }
+
+    return obj_bool(1);
+}
+
+static LObject native_eq(Interp *I, Arena *a, LObject *args, size_t count) { (void)I; (void)a; return native_cmp(CMP_EQ, args, count); }
+static LObject native_lt(Interp *I, Arena *a, LObject *args, size_t count) { (void)I; (void)a; return native_cmp(CMP_LT, args, count); }
+static LObject native_gt(Interp *I, Arena *a, LObject *args, size_t count) { (void)I; (void)a; return native_cmp(CMP_GT, args, count); }
+
+// Waits for value of future, other values are returned as is
+static LObject native_touch(Interp *I, Arena *a, LObject *args, size_t count)
+{
+    (void)count;
+    return future_touch(I, a, args[0]);
+}
+
+static void natives_builtins(Interp *I)
+{
+    native_register(I, "+", native_add, 1, NATIVE_VARIADIC, NATIVE_NUMBER)->op = ARITH_ADD;
+    native_register(I, "-", native_sub, 1, NATIVE_VARIADIC, NATIVE_NUMBER)->op = ARITH_SUB;
+    native_register(I, "*", native_mul, 1, NATIVE_VARIADIC, NATIVE_NUMBER)->op = ARITH_MUL;
+    native_register(I, "/", native_div, 1, NATIVE_VARIADIC, NATIVE_NUMBER)->op = ARITH_DIV;
+    native_register(I, "=", native_eq, 2, NATIVE_VARIADIC, NATIVE_NUMBER);
+    native_register(I, "<", native_lt, 2, NATIVE_VARIADIC, NATIVE_NUMBER);
+    native_register(I, ">", native_gt, 2, NATIVE_VARIADIC, NATIVE_NUMBER);
+    native_register(I, "touch", native_touch, 1, 1, NATIVE_ANY);
+}
+
+// Builtins are registered on first use of registry
+LAM_FUNC Natives *natives_get(Interp *I)
+{
+    if (!I->natives.capacity) {
+        natives_grow(&I->natives);
+        natives_builtins(I);
+    }
+    return &I->natives;
+}
+
+/*
+ * Api
+ */
+
+Native *native_register(Interp *I, const char *name, Native_Fn fn,
+                        size_t min_args, size_t max_args, unsigned types)
+{
+    Symbol *sym = intern_cstr(I, name);
+    Native *n = natives_put(natives_get(I), sym);
+
+    n->name = sym;
+    n->fn = fn;
+    n->min_args = min_args;
+    n->max_args = max_args;
+    n->types = types;
+    n->op = -1;
+
+    return n;
+}
+
+Native *lam_register_native(Interp *I, const char *name, Native_Fn fn, size_t min_args, size_t max_args)
+{
+    return native_register(I, name, fn, min_args, max_args, NATIVE_ANY);
+}
+
+Native *native_find(Interp *I, Symbol *name)
+{
+    Native_Slot *s = natives_slot(natives_get(I), name);
+    return s->native;
+}
+
+LObject native_fail_type(Arena *a, Native *n, size_t i, LObj_Type t)
+{
+    return obj_fail(a, "Invalid type `%s` of argument %zu for `"SV_Fmt"`", obj_type_name(t), i + 1, SV_Args(n->name->sv));
+}
+
+// Checks arity and types of arguments before call.
+// Function which fails without error gets generic one
+LObject native_call(Interp *I, Arena *a, Native *n, LObject *args, size_t count)
+{
+    if (count < n->min_args || count > n->max_args) {
+        if (n->max_args == NATIVE_VARIADIC)
+            return obj_fail(a, "Function `"SV_Fmt"` expects at least %zu argument%s, but provided %zu",
+                            SV_Args(n->name->sv), n->min_args, plural_s(n->min_args), count);
+        if (n->min_args == n->max_args)
+            return obj_fail(a, "Function `"SV_Fmt"` expects %zu argument%s, but provided %zu",
+                            SV_Args(n->name->sv), n->min_args, plural_s(n->min_args), count);
+        return obj_fail(a, "Function `"SV_Fmt"` expects %zu..%zu arguments, but provided %zu",
+                        SV_Args(n->name->sv), n->min_args, n->max_args, count);
+    }
+
+    if (n->types != NATIVE_ANY) {
+        for (size_t i = 0; i < count; ++i) {
+            LObj_Type t = obj_type(args[i]);
+            if (!(n->types & TYPE_BIT(t))) return native_fail_type(a, n, i, t);
+        }
+    }
+
+    if (I->prof) prof_funcall(I->prof);
+    LObject out = n->fn(I, a, args, count);
+    if (out == OBJ_NONE) return obj_fail(a, "Function `"SV_Fmt"` failed", SV_Args(n->name->sv));
+    return out;
+}
@@ -0,0 +1,57 @@
+#ifndef NATIVE_H_
+#define NATIVE_H_
+
+#include "types.h"
+#include "arena.h"
+#include "arith.h"
+
+/*
+ * Native function gets evaluated arguments in buffer that it may use
+ * as scratch memory. Result can be allocated in provided arena.
+ * Failure is returned by `obj_fail`, place of call is added by interpreter.
+ */
+typedef LObject (*Native_Fn)(Interp *I, Arena *a, LObject *args, size_t count);
+
+#define NATIVE_VARIADIC ((size_t)-1)
+
+// Masks of accepted types of arguments
+#define TYPE_BIT(t)    (1u << (t))
+#define NATIVE_ANY     (~0u)
+#define NATIVE_NUMBER  (TYPE_BIT(OBJ_TYPE_INT) | TYPE_BIT(OBJ_TYPE_FLT))
+
+struct Native {
+    Symbol *name;
+    Native_Fn fn;
+    size_t min_args;
+    size_t max_args;  // NATIVE_VARIADIC if unlimited
+    unsigned types;   // Mask of accepted types for every argument
+    int op;           // Arith_Op for builtin arithmetic, -1 otherwise. Used by compiler
+};
+
+typedef struct {
+    Symbol *name;
+    Native *native;
+} Native_Slot;
+
+// Open addressing table keyed by interned name
+typedef struct {
+    Native_Slot *slots;
+    size_t capacity;
+    size_t count;
+    Arena arena;
+} Natives;
+
+#define NATIVES_INIT_CAPACITY 64 // Must be power of two
+
+LAM_API Native *native_register(Interp *I, const char *name, Native_Fn fn,
+                                size_t min_args, size_t max_args, unsigned types);
+LAM_API Native *native_find(Interp *I, Symbol *name);
+LAM_API LObject native_call(Interp *I, Arena *a, Native *n, LObject *args, size_t count);
+// Failure of argument `i` (from 0) which has type `t` not accepted by `n`
+LAM_API LObject native_fail_type(Arena *a, Native *n, size_t i, LObj_Type t);
+
+// Registers function callable from lambda, every type of arguments is accepted.
+// Registering existing name replaces previous function
+LAM_API Native *lam_register_native(Interp *I, const char *name, Native_Fn fn, size_t min_args, size_t max_args);
+
+#endif // NATIVE_H_
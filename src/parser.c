@@ -1,12 +1,15 @@
 #include <assert.h>
+#include <stdarg.h>
 #include "parser.h"
-
-static char *builtin_funcs = "+-*/";
+#include "intern.h"
+#include "native.h"
+#include "env.h"
+#include "interp.h"
 
 String_View *sv_dy(Arena *a, String_View sv)
 {
     String_View *s = arena_alloc(a, sizeof(String_View));
-    s->data = arena_alloc(a, sv.count);
+    s->data = arena_alloc_raw(a, sv.count, 1);
     memcpy(s->data, sv.data, sv.count);
     s->count = sv.count;
     return s;
@@ -14,12 +17,12 @@ String_View *sv_dy(Arena *a, String_View sv)
 
 LObject obj_from_atom(Arena *a, Atom atom)
 {
-    LObject o = {0};
+    LObject o = OBJ_NIL;
      
     switch (atom.t) {
-        case ATOM_FLT: o = OBJ_FLT(atom.v.as_flt); break;
-        case ATOM_INT: o = OBJ_INT(atom.v.as_int); break;
-        case ATOM_STR: o = OBJ_STR(sv_dy(a, atom.v.as_str)); break;
+        case ATOM_FLT: o = obj_flt(atom.v.as_flt); break;
+        case ATOM_INT: o = obj_int(a, atom.v.as_int); break;
+        case ATOM_STR: o = obj_str(&atom.v.as_str->sv); break;
         case ATOM_NIL: o = OBJ_NIL; break;
         default: {
             assert(0 && "Unreachable atom type");
@@ -29,190 +32,688 @@ LObject obj_from_atom(Arena *a, Atom atom)
     return o;
 }
 
-Atom parse_atom(Token tk)
+LAM_FUNC Loc token_loc(Lexer *L, Token tk)
+{
+    return (Loc) { .file = L->file, .row = (u32)tk.row, .col = (u32)tk.col };
+}
+
+// Error is formatted into arena of form, so nothing is allocated until something fails.
+// Place of end of input is where lexer stopped
+Expr parse_error(Arena *a, Lexer *L, Token tk, const char *fmt, ...)
+{
+    Loc at = token_loc(L, tk);
+    if (tk.type == TK_NONE) {
+        at.row = L->linenumber;
+        at.col = (u32)(L->src.data - L->linestart) + 1;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    Error *err = error_vformat(a, at, fmt, args);
+    va_end(args);
+
+    return (Expr) { .t = EXPR_ERROR, .v.err = err };
+}
+
+LAM_FUNC Expr parse_unexpected(Arena *a, Lexer *L, Token tk, const char *expected)
 {
-    Atom a = {0};
+    if (tk.type == TK_NONE) return parse_error(a, L, tk, "Expected %s, but source ended", expected);
+    if (tk.type == TK_OPEN_PAREN || tk.type == TK_CLOSE_PAREN)
+        return parse_error(a, L, tk, "Expected %s, but got %s", expected, token_name(tk.type));
+    return parse_error(a, L, tk, "Expected %s, but got %s `"SV_Fmt"`",
+                       expected, token_name(tk.type), SV_Args(tk.text));
+}
+
+Expr parse_atom(Interp *I, Arena *a, Lexer *L, Token tk)
+{
+    Expr e = { .t = EXPR_ATOM };
+    Atom *atom = &e.v.a;
 
     switch (tk.type) {
+        case TK_NIL: {
+            atom->t = ATOM_NIL;
+            break;
+        }
         case TK_STRING: {
-            a.t = ATOM_STR;
-            a.v.as_str = tk.text;
+            atom->t = ATOM_STR;
+            atom->v.as_str = intern(I, tk.text);
             break;
         }
         case TK_NUMBER: {
-            if (sv_is_float(tk.text)) {
-                a.t = ATOM_FLT;
-                a.v.as_flt = sv_to_flt(tk.text);
+            if (!sv_is_float(tk.text)) {
+                atom->t = ATOM_INT;
+                atom->v.as_int = sv_to_int(tk.text);
+            } else if (sv_to_flt(tk.text, &atom->v.as_flt)) {
+                atom->t = ATOM_FLT;
             } else {
-                a.t = ATOM_INT;
-                a.v.as_int = sv_to_int(tk.text);
+                return parse_error(a, L, tk, "Invalid number `"SV_Fmt"`", SV_Args(tk.text));
             }
             break;
         }
         default: {
-            report("Invalid token for expr: %u\n", tk.type);
-            exit(1);
+            return parse_unexpected(a, L, tk, "value");
         }
     }
 
-    return a;
+    return e;
 }
 
-Funcall *funcall_new(Arena *a, String_View name)
+// Input `$N` refers to N-th value provided for evaluation
+Expr parse_input(Arena *a, Lexer *L, Token tk)
+{
+    Expr e = {0};
+    String_View n = sv_from_parts(tk.text.data + 1, tk.text.count - 1);
+
+    for (size_t i = 0; i < n.count; ++i) {
+        if (n.data[i] < '0' || n.data[i] > '9') n.count = 0;
+    }
+
+    if (n.count == 0)
+        return parse_error(a, L, tk, "Invalid input `"SV_Fmt"`, expected `$` with index", SV_Args(tk.text));
+
+    e.t = EXPR_INPUT;
+    e.v.input = sv_to_int(n);
+    return e;
+}
+
+Funcall *funcall_new(Arena *a, Symbol *name)
 {
     Funcall *f = arena_alloc(a, sizeof(Funcall));
     f->name = name;
     return f;
 }
 
-Funcall *parse_funcall(Arena *a, Lexer *L)
+LAM_FUNC int keyword(Interp *I, Symbol *name)
 {
-    Token tk = lexer_yield(L, TK_OPERATOR);
-    if (lexstatus_err(L)) return NULL;
+    Symbol **keywords = I->keywords;
+    if (!keywords[KW_DEFINE]) {
+        keywords[KW_DEFINE] = intern_cstr(I, "define");
+        keywords[KW_LET] = intern_cstr(I, "let");
+        keywords[KW_LAMBDA] = intern_cstr(I, "lambda");
+        keywords[KW_IF] = intern_cstr(I, "if");
+        keywords[KW_FUTURE] = intern_cstr(I, "future");
+    }
 
-    Funcall *f = funcall_new(a, tk.text);
-    tk = lexer_peek(L);
+    for (int i = 0; i < KW_COUNT; ++i) {
+        if (keywords[i] == name) return i;
+    }
 
-    while (tk.type != TK_CLOSE_PAREN && tk.type != TK_NONE) {
-        Expr e = parse_expr(a, L);
-        if (e.t == EXPR_NONE) {
-            f = NULL;
-            break;
+    return -1;
+}
+
+// Lambda between use of variable and its binding
+typedef struct {
+    Lambda *fn;
+    u32 depth; // Of scope of lambda from scope of use
+} Crossed;
+
+// Finds name in lexical scopes from innermost, otherwise it refers to global.
+// Later bindings of same frame shadows earlier. Frame of lambda has no parent
+// at run time, so variable of outer scope is captured into it after arguments.
+// Lambdas between use and binding are remembered on stack of parser and
+// capture variable from outermost one, so every of them passes it to next
+Expr parse_var(Interp *I, Arena *a, Scope *sc, Symbol *name)
+{
+    Expr e = {0};
+    struct {
+        size_t count;
+        size_t capacity;
+        Crossed *items;
+    } crossed = {0};
+
+    for (u32 depth = 0; sc; sc = sc->parent, ++depth) {
+        for (size_t i = sc->count; i-- > 0;) {
+            if (sc->names[i] != name) continue;
+
+            Local local = { .depth = depth, .slot = (u32)i };
+            while (crossed.count > 0) {
+                Crossed x = crossed.items[--crossed.count];
+                Lambda *fn = x.fn;
+                Local outer = { .depth = local.depth - x.depth - 1, .slot = local.slot };
+
+                size_t c = 0;
+                while (c < fn->captures.count) {
+                    Local l = fn->captures.items[c];
+                    if (l.depth == outer.depth && l.slot == outer.slot) break;
+                    ++c;
+                }
+                if (c == fn->captures.count) arena_da_append(a, &fn->captures, outer, 4);
+
+                local = (Local) { .depth = x.depth, .slot = fn->arity + (u32)c };
+            }
+
+            e.t = EXPR_LOCAL;
+            e.v.local = local;
+            return e;
         }
 
-        funarg_append(a, &f->args, e);
-        tk = lexer_peek(L);
+        if (sc->fn) arena_da_append(&I->parse, &crossed, ((Crossed) { sc->fn, depth }), 8);
     }
 
-    return f;
+    e.t = EXPR_GLOBAL;
+    e.v.global = global_get(I, name);
+    return e;
+}
+
+/*
+ * Forms are parsed by single loop of `parse_tree` without recursion. Form which
+ * waits for its next expression is kept as frame on stack of parser, so nesting
+ * is limited only by memory. Stack, arguments and names of bindings are kept in
+ * arena of interpreter, which is reused by every statement, so arena of form
+ * gets only tree itself and arguments are copied into it once form is closed
+ */
+typedef enum {
+    FRAME_CONTEXT = 0, // `(` expression [arguments] `)`, when it doesn't begin from name
+    FRAME_ARGS,        // Arguments of call until `)`
+    FRAME_DEFINE,
+    FRAME_LET,         // Values of bindings, then body
+    FRAME_LAMBDA,
+    FRAME_FUTURE,
+    FRAME_IF,
+} Frame_Kind;
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    Symbol **items;
+} Names;
+
+typedef struct {
+    Frame_Kind kind;
+    int state;      // Context may be call of expression, body of let, count of parsed parts of if
+    int close;      // Form began context, so it takes `)` of context
+    Scope *sc;      // Scope of expressions of form
+    size_t base;    // Arguments and values of bindings are on stack above it
+    Names names;    // Arguments of lambda or bindings of let
+    union {
+        Funcall *f;
+        Define *def;
+        Let *let;
+        Lambda *fn;
+        If *cond;
+    } v;
+} Frame;
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    Frame *items;
+} Frames;
+
+// Form which begins context closes it, so `(f x)` and `(let ...)` take single frame
+LAM_FUNC Frame *frame_push(Arena *s, Frames *fs, Frame f, int *close)
+{
+    f.close = *close;
+    *close = 0;
+    arena_da_append(s, fs, f, 64);
+    return &fs->items[fs->count - 1];
+}
+
+LAM_FUNC Frame *frame_top(Frames *fs)
+{
+    return &fs->items[fs->count - 1];
+}
+
+// Expression is parsed in scope of form which waits for it
+LAM_FUNC Scope *frame_scope(Frames *fs, Scope *sc)
+{
+    return fs->count ? frame_top(fs)->sc : sc;
+}
+
+LAM_FUNC Scope *scope_new(Arena *s, Scope *parent, Names *names, Lambda *fn)
+{
+    Scope *sc = arena_alloc(s, sizeof(Scope));
+    sc->parent = parent;
+    sc->names = names ? names->items : NULL;
+    sc->count = names ? names->count : 0;
+    sc->fn = fn;
+    return sc;
+}
+
+// Moves arguments of form from stack into array of exact size in arena of tree
+LAM_FUNC void funargs_take(Arena *a, Funargs *dst, Funargs *stack, size_t base)
+{
+    size_t n = stack->count - base;
+    dst->count = dst->capacity = n;
+    dst->items = NULL;
+    if (n) {
+        dst->items = arena_alloc_raw(a, sizeof(Expr) * n, sizeof(void*));
+        memcpy(dst->items, stack->items + base, sizeof(Expr) * n);
+    }
+    stack->count = base;
+}
+
+LAM_FUNC int token_is_leaf(Token_Type t)
+{
+    return t == TK_NIL || t == TK_STRING || t == TK_NUMBER || t == TK_TEXT;
+}
+
+// Atom, input or variable from next token
+LAM_FUNC Expr parse_leaf(Interp *I, Arena *a, Lexer *L, Scope *sc)
+{
+    Token tk = lexer_next(L);
+    if (tk.type != TK_TEXT) return parse_atom(I, a, L, tk);
+    if (tk.text.data[0] == '$') return parse_input(a, L, tk);
+    return parse_var(I, a, sc, intern(I, tk.text));
 }
 
-Expr parse_expr(Arena *a, Lexer *L)
+// Parses context if `context` is set, otherwise any expression.
+// Labels are steps of grammar, parsed expression is given back to form on top
+// of stack at `done`. Token which is already peeked is dispatched at `peeked`.
+// Errors are returned as soon as they are found
+LAM_FUNC Expr parse_tree(Interp *I, Arena *a, Lexer *L, Scope *sc, int context)
 {
+    Arena *s = &I->parse;
+    Frames frames = {0};
+    Funargs stack = {0};
+    Frame *top = NULL;
     Expr e = {0};
-    Token tk = lexer_peek(L);
+    Token tk = {0};
+    int close = 0;  // Next form takes `)` of context
+
+    arena_reset(s);
+    if (context) goto context;
 
+expr:
+    tk = lexer_peek(L);
+peeked:
     switch (tk.type) {
         case TK_NIL:
         case TK_STRING:
-        case TK_NUMBER: {
-            tk = lexer_next(L);
-            e.v.a = parse_atom(tk);
-            e.t = EXPR_ATOM;
+        case TK_NUMBER:
+        case TK_TEXT: {
+            e = parse_leaf(I, a, L, frame_scope(&frames, sc));
+            goto done;
+        }
+        case TK_OPERATOR: goto funcall;
+        case TK_OPEN_PAREN: goto context;
+        default: return parse_unexpected(a, L, lexer_next(L), "expression");
+    }
+
+context:
+    tk = lexer_yield(L, TK_OPEN_PAREN);
+    if (lexstatus_err(L)) return parse_unexpected(a, L, tk, "`(`");
+
+    // Context which begins from name is special form or call.
+    // Single name is call without arguments, for non function it's value of variable
+    tk = lexer_peek(L);
+    close = 1;
+    if (tk.type == TK_OPERATOR) goto funcall;
+    if (tk.type != TK_TEXT || tk.text.data[0] == '$') {
+        frame_push(s, &frames, (Frame) {
+            .kind = FRAME_CONTEXT,
+            .state = tk.type == TK_OPEN_PAREN,
+            .sc = frame_scope(&frames, sc),
+        }, &close);
+        goto peeked;
+    }
+
+    switch (keyword(I, intern(I, tk.text))) {
+        case KW_DEFINE: lexer_next(L); goto define;
+        case KW_LET: lexer_next(L); goto let;
+        case KW_LAMBDA: lexer_next(L); goto lambda;
+        case KW_IF: lexer_next(L); goto cond;
+        case KW_FUTURE: lexer_next(L); goto future;
+        default: goto funcall;
+    }
+
+funcall: {
+    tk = lexer_next(L);
+    if (tk.type != TK_OPERATOR && tk.type != TK_TEXT)
+        return parse_unexpected(a, L, tk, "name of function");
+
+    Scope *inner = frame_scope(&frames, sc);
+    Funcall *f = funcall_new(a, intern(I, tk.text));
+    f->native = native_find(I, f->name);
+    f->at = token_loc(L, tk);
+
+    // Variable shadows native, unless it's global which was never defined
+    if (tk.type == TK_TEXT) {
+        Expr v = parse_var(I, a, inner, f->name);
+        if (v.t == EXPR_LOCAL || v.v.global->bound || !f->native) f->callee = v;
+    }
+
+    frame_push(s, &frames, (Frame) { .kind = FRAME_ARGS, .sc = inner, .base = stack.count, .v.f = f }, &close);
+    goto args;
+}
+
+// Leaves are appended right away, most of arguments are atoms and variables
+args:
+    tk = lexer_peek(L);
+    while (token_is_leaf(tk.type)) {
+        e = parse_leaf(I, a, L, frame_top(&frames)->sc);
+        if (e.t == EXPR_ERROR) return e;
+        funarg_append(s, &stack, e);
+        tk = lexer_peek(L);
+    }
+    if (tk.type != TK_CLOSE_PAREN && tk.type != TK_NONE) goto peeked;
+
+    top = frame_top(&frames);
+    funargs_take(a, &top->v.f->args, &stack, top->base);
+    e = (Expr) { .t = EXPR_FUNCALL, .v.f = top->v.f };
+    goto pop;
+
+// (define name value)
+define: {
+    tk = lexer_yield(L, TK_TEXT);
+    if (lexstatus_err(L)) return parse_unexpected(a, L, tk, "name of variable");
+
+    Define *def = arena_alloc(a, sizeof(Define));
+    def->global = global_get(I, intern(I, tk.text));
+    frame_push(s, &frames, (Frame) { .kind = FRAME_DEFINE, .sc = frame_scope(&frames, sc), .v.def = def }, &close);
+    goto expr;
+}
+
+// (let ((name value) ...) body)
+let: {
+    Let *let = arena_alloc(a, sizeof(Let));
+    tk = lexer_yield(L, TK_OPEN_PAREN);
+    if (lexstatus_err(L)) return parse_unexpected(a, L, tk, "list of bindings");
+
+    frame_push(s, &frames, (Frame) { .kind = FRAME_LET, .sc = frame_scope(&frames, sc), .base = stack.count, .v.let = let }, &close);
+    goto bindings;
+}
+
+bindings:
+    top = frame_top(&frames);
+    if (lexer_peek(L).type == TK_OPEN_PAREN) {
+        lexer_next(L);
+        tk = lexer_yield(L, TK_TEXT);
+        if (lexstatus_err(L)) return parse_unexpected(a, L, tk, "name of variable");
+
+        arena_da_append(s, &top->names, intern(I, tk.text), 8);
+        goto expr;
+    }
+
+    tk = lexer_yield(L, TK_CLOSE_PAREN);
+    if (lexstatus_err(L)) return parse_unexpected(a, L, tk, "`(` or `)` in bindings");
+
+    funargs_take(a, &top->v.let->inits, &stack, top->base);
+    top->sc = scope_new(s, top->sc, &top->names, NULL);
+    top->state = 1;
+    goto expr;
+
+// (lambda (name ...) body)
+lambda: {
+    Lambda *fn = arena_alloc(a, sizeof(Lambda));
+    tk = lexer_yield(L, TK_OPEN_PAREN);
+    if (lexstatus_err(L)) return parse_unexpected(a, L, tk, "list of arguments");
+
+    top = frame_push(s, &frames, (Frame) { .kind = FRAME_LAMBDA, .sc = frame_scope(&frames, sc), .v.fn = fn }, &close);
+    while (lexer_peek(L).type == TK_TEXT) {
+        tk = lexer_next(L);
+        arena_da_append(s, &top->names, intern(I, tk.text), 8);
+    }
+
+    tk = lexer_yield(L, TK_CLOSE_PAREN);
+    if (lexstatus_err(L)) return parse_unexpected(a, L, tk, "name of argument or `)`");
+
+    fn->arity = top->names.count;
+    top->sc = scope_new(s, top->sc, &top->names, fn);
+    goto expr;
+}
+
+// (future expr). Body is parsed as lambda without arguments, so it captures variables
+future: {
+    Lambda *fn = arena_alloc(a, sizeof(Lambda));
+    Scope *inner = scope_new(s, frame_scope(&frames, sc), NULL, fn);
+    frame_push(s, &frames, (Frame) { .kind = FRAME_FUTURE, .sc = inner, .v.fn = fn }, &close);
+    goto expr;
+}
+
+// (if cond then [otherwise])
+cond: {
+    If *cond = arena_alloc(a, sizeof(If));
+    frame_push(s, &frames, (Frame) { .kind = FRAME_IF, .sc = frame_scope(&frames, sc), .v.cond = cond }, &close);
+    goto expr;
+}
+
+done:
+    if (e.t == EXPR_ERROR || frames.count == 0) return e;
+
+    top = frame_top(&frames);
+    switch (top->kind) {
+        case FRAME_CONTEXT: {
+            // Context is call of expression if something follows it: ((lambda (x) x) 1)
+            if (top->state && lexer_peek(L).type != TK_CLOSE_PAREN) {
+                Funcall *f = funcall_new(a, intern_cstr(I, "lambda"));
+                f->callee = e;
+                f->at = token_loc(L, lexer_peek(L));
+                top->state = 0;
+                frame_push(s, &frames, (Frame) { .kind = FRAME_ARGS, .sc = top->sc, .base = stack.count, .v.f = f }, &close);
+                goto args;
+            }
             break;
         }
-        case TK_OPERATOR: case TK_TEXT: {
-            e.v.f = parse_funcall(a, L);
-            if (!e.v.f) break;
-            e.t = EXPR_FUNCALL;
+
+        case FRAME_ARGS: {
+            funarg_append(s, &stack, e);
+            goto args;
+        }
+
+        case FRAME_DEFINE: {
+            top->v.def->value = e;
+            e = (Expr) { .t = EXPR_DEFINE, .v.def = top->v.def };
             break;
         }
-        case TK_OPEN_PAREN: {
-            Statement s = parse_statement(a, L);
-            if (s.t == STATEMENT_NONE) break;
-            e = stateval(a, &s);
+
+        case FRAME_LET: {
+            if (top->state) {
+                top->v.let->body = e;
+                e = (Expr) { .t = EXPR_LET, .v.let = top->v.let };
+                break;
+            }
+
+            Token close = lexer_yield(L, TK_CLOSE_PAREN);
+            if (lexstatus_err(L)) return parse_unexpected(a, L, close, "`)` after binding");
+
+            funarg_append(s, &stack, e);
+            goto bindings;
+        }
+
+        case FRAME_LAMBDA:
+        case FRAME_FUTURE: {
+            top->v.fn->body = e;
+            e = (Expr) { .t = top->kind == FRAME_LAMBDA ? EXPR_LAMBDA : EXPR_FUTURE, .v.lambda = top->v.fn };
+            break;
+        }
+
+        case FRAME_IF: {
+            If *cond = top->v.cond;
+            Expr *parts[] = { &cond->cond, &cond->then, &cond->otherwise };
+            *parts[top->state++] = e;
+
+            if (top->state < 2 || (top->state == 2 && lexer_peek(L).type != TK_CLOSE_PAREN)) goto expr;
+            e = (Expr) { .t = EXPR_IF, .v.cond = cond };
             break;
         }
+
         default: {
-            assert(0 && "Cannot parse current expresion");
+            assert(0 && "Unreachable frame kind");
         }
     }
 
-    return e;
+pop:
+    if (top->close) {
+        tk = lexer_yield(L, TK_CLOSE_PAREN);
+        if (lexstatus_err(L)) return parse_unexpected(a, L, tk, "`)`");
+    }
+    frames.count -= 1;
+    goto done;
 }
 
-Statement parse_statement(Arena *a, Lexer *L)
+Expr parse_expr(Interp *I, Arena *a, Lexer *L, Scope *sc)
+{
+    return parse_tree(I, a, L, sc, 0);
+}
+
+Expr parse_context(Interp *I, Arena *a, Lexer *L, Scope *sc)
+{
+    return parse_tree(I, a, L, sc, 1);
+}
+
+// Top-level context, it has no lexical scope.
+// After error rest of form is skipped, so next call parses next form
+Statement parse_statement(Interp *I, Arena *a, Lexer *L)
 {
     Statement s = {0};
-    lexer_yield(L, TK_OPEN_PAREN);
+    Token first = lexer_peek(L);
+    Expr e = parse_context(I, a, L, NULL);
+
+    if (e.t == EXPR_ERROR) {
+        if (first.type == TK_OPEN_PAREN) lexer_skip_form(L, first);
+        else if (lexstatus_err(L)) L->status = LEXSTATUS_OK;
 
-    if (lexstatus_err(L)) {
-        report("Expected context. Cannot parse anything");
-        return STATE_NONE;
+        s.t = STATEMENT_ERROR;
+        s.v.err = e.v.err;
+        return s;
     }
-   
+
     s.t = STATEMENT_VOID;
-    s.v.e = parse_expr(a, L);
+    s.v.e = e;
+    s.at = token_loc(L, first);
+    return s;
+}
 
-    if (s.v.e.t == EXPR_NONE) goto defer;
-    
-    lexer_yield(L, TK_CLOSE_PAREN);
-    if (lexstatus_err(L)) goto defer;
+/*
+ * Walks of trees keep expressions which are left to visit on stack in
+ * temporary arena, so they don't depend on depth of tree either
+ */
 
-    return s;
+typedef struct {
+    size_t count;
+    size_t capacity;
+    Expr **items;
+} Expr_Stack;
 
-defer:
-    return STATE_NONE;
+LAM_FUNC void expr_push(Arena *s, Expr_Stack *st, Expr *e)
+{
+    if (e->t != EXPR_NONE) arena_da_append(s, st, e, 64);
 }
 
-Expr statfuncall(Funcall *f)
+// Pushes subexpressions of node, children of copied node are copied later
+LAM_FUNC void expr_push_children(Arena *s, Expr_Stack *st, Expr *e)
 {
-    Expr out = {0};
-    String_View builtins = sv_from_cstr(builtin_funcs);
-    if (!char_in_sv(builtins, f->name.data[0])) {
-        report("Unknown function name `"SV_Fmt"`", SV_Args(f->name));
-        report("Note: for now lambda can parse only builtins: + - * /");
-        return EXPR_EMPTY;
-    }
+    switch (e->t) {
+        case EXPR_FUNCALL: {
+            expr_push(s, st, &e->v.f->callee);
+            for (size_t i = 0; i < e->v.f->args.count; ++i) expr_push(s, st, &e->v.f->args.items[i]);
+            break;
+        }
+
+        case EXPR_LET: {
+            for (size_t i = 0; i < e->v.let->inits.count; ++i) expr_push(s, st, &e->v.let->inits.items[i]);
+            expr_push(s, st, &e->v.let->body);
+            break;
+        }
+
+        case EXPR_DEFINE: expr_push(s, st, &e->v.def->value); break;
+        case EXPR_LAMBDA:
+        case EXPR_FUTURE: expr_push(s, st, &e->v.lambda->body); break;
 
-    if (f->args.items[0].t != EXPR_ATOM) {
-        report("Cannot parse non-atom type `%u`", f->args.items[0].t);
-        return EXPR_EMPTY;
-    } else {
-        out.t = EXPR_ATOM;
-        out.v.a.t = f->args.items[0].v.a.t;
+        case EXPR_IF: {
+            expr_push(s, st, &e->v.cond->cond);
+            expr_push(s, st, &e->v.cond->then);
+            expr_push(s, st, &e->v.cond->otherwise);
+            break;
+        }
+
+        default: break;
     }
+}
 
-    switch (f->name.data[0]) {
-        case '+': {
-            arethOp(+, f->args.items,  f->args.count, &out.v.a);
+LAM_FUNC void funargs_copy(Arena *a, Funargs *dst, Funargs *src)
+{
+    dst->count = dst->capacity = src->count;
+    dst->items = arena_alloc_raw(a, sizeof(Expr) * src->count, sizeof(void*));
+    if (src->count) memcpy(dst->items, src->items, sizeof(Expr) * src->count);
+}
+
+// Copies node, its children still refer to source tree until they are copied
+LAM_FUNC void expr_copy_node(Arena *a, Expr *e)
+{
+    switch (e->t) {
+        case EXPR_FUNCALL: {
+            Funcall *f = funcall_new(a, e->v.f->name);
+            f->native = e->v.f->native;
+            f->callee = e->v.f->callee;
+            f->at = e->v.f->at;
+            funargs_copy(a, &f->args, &e->v.f->args);
+            e->v.f = f;
             break;
         }
-        case '-': {
-            arethOp(-, f->args.items,  f->args.count, &out.v.a);
+
+        case EXPR_LET: {
+            Let *let = arena_alloc(a, sizeof(Let));
+            funargs_copy(a, &let->inits, &e->v.let->inits);
+            let->body = e->v.let->body;
+            e->v.let = let;
             break;
         }
-        case '*': {
-            arethOp(*, f->args.items,  f->args.count, &out.v.a);
+
+        case EXPR_DEFINE: {
+            Define *def = arena_alloc(a, sizeof(Define));
+            def->global = e->v.def->global;
+            def->value = e->v.def->value;
+            e->v.def = def;
             break;
         }
-        case '/': {
-            arethOp(/, f->args.items,  f->args.count, &out.v.a);
+
+        case EXPR_LAMBDA:
+        case EXPR_FUTURE: {
+            Lambda *fn = arena_alloc(a, sizeof(Lambda));
+            Locals *caps = &e->v.lambda->captures;
+            fn->arity = e->v.lambda->arity;
+            fn->captures.count = fn->captures.capacity = caps->count;
+            fn->captures.items = arena_alloc_raw(a, sizeof(Local) * caps->count, sizeof(Local));
+            if (caps->count) memcpy(fn->captures.items, caps->items, sizeof(Local) * caps->count);
+            fn->body = e->v.lambda->body;
+            e->v.lambda = fn;
             break;
         }
-        default: {
-            assert(0 && "Unreachable funcall");
+
+        case EXPR_IF: {
+            If *cond = arena_alloc(a, sizeof(If));
+            *cond = *e->v.cond;
+            e->v.cond = cond;
+            break;
         }
+
+        default: break;
     }
+}
 
-    return out;
+// Deep copy of tree. Symbols, natives and globals are shared
+Expr expr_copy(Arena *a, Expr e)
+{
+    Arena s = {0};
+    Expr_Stack st = {0};
+
+    expr_push(&s, &st, &e);
+    while (st.count > 0) {
+        Expr *top = st.items[--st.count];
+        expr_copy_node(a, top);
+        expr_push_children(&s, &st, top);
+    }
+
+    arena_free(&s);
+    return e;
 }
 
-Expr stateval(Arena *a, Statement *s)
+size_t expr_count(Expr *e)
 {
-    (void)a;
-    Expr output = {0};
-
-    switch (s->t) {
-        case STATEMENT_VOID: {
-            Expr e = s->v.e;
-            if (e.t == EXPR_FUNCALL) {
-                output = statfuncall(e.v.f);
-                break;
-            } else if (e.t == EXPR_ATOM) {
-                output = e;
-                break;
-            } else {
-                assert(0 && "Unreachable expr type");
-            }
-            break;
-        }
-        default: {
-            assert(0 && "Unreachable state type");
-        }
+    Arena s = {0};
+    Expr_Stack st = {0};
+    size_t n = 0;
+
+    expr_push(&s, &st, e);
+    while (st.count > 0) {
+        n += 1;
+        expr_push_children(&s, &st, st.items[--st.count]);
     }
 
-    return output;
+    arena_free(&s);
+    return n;
 }
 
 /*
@@ -234,7 +735,7 @@ LAM_FUNC void atom_dump(Atom a)
     switch (a.t) {
         case ATOM_INT: printf("%lli", a.v.as_int); break;
         case ATOM_FLT: printf("%lf", a.v.as_flt); break;
-        case ATOM_STR: printf(SV_Fmt, SV_Args(a.v.as_str)); break;
+        case ATOM_STR: printf(SV_Fmt, SV_Args(a.v.as_str->sv)); break;
         case ATOM_NIL: printf("nil"); break;
         default: {
             assert(0 && "unreachable type of atom");
@@ -250,13 +751,91 @@ LAM_FUNC void expr_dump(Expr e, size_t pad)
             break;
         }
 
+        case EXPR_INPUT: {
+            printf("$%zu", e.v.input);
+            break;
+        }
+
+        case EXPR_LOCAL: {
+            printf("(local %u %u)", e.v.local.depth, e.v.local.slot);
+            break;
+        }
+
+        case EXPR_GLOBAL: {
+            printf(SV_Fmt, SV_Args(e.v.global->name->sv));
+            break;
+        }
+
+        case EXPR_DEFINE: {
+            PADDING(2*pad);
+            printf("(define "SV_Fmt" ", SV_Args(e.v.def->global->name->sv));
+            expr_dump(e.v.def->value, pad + 1);
+            printf(")\n");
+            break;
+        }
+
+        case EXPR_LAMBDA: {
+            Lambda *fn = e.v.lambda;
+            PADDING(2*pad);
+            printf("(lambda %u (captures", fn->arity);
+            for (size_t i = 0; i < fn->captures.count; ++i)
+                printf(" (local %u %u)", fn->captures.items[i].depth, fn->captures.items[i].slot);
+            printf(")\n");
+            expr_dump(fn->body, pad + 1);
+            PADDING(2*pad);
+            printf(")\n");
+            break;
+        }
+
+        case EXPR_FUTURE: {
+            Lambda *fn = e.v.lambda;
+            PADDING(2*pad);
+            printf("(future (captures");
+            for (size_t i = 0; i < fn->captures.count; ++i)
+                printf(" (local %u %u)", fn->captures.items[i].depth, fn->captures.items[i].slot);
+            printf(")\n");
+            expr_dump(fn->body, pad + 1);
+            PADDING(2*pad);
+            printf(")\n");
+            break;
+        }
+
+        case EXPR_IF: {
+            PADDING(2*pad);
+            printf("(if ");
+            expr_dump(e.v.cond->cond, pad + 1);
+            printf(" ");
+            expr_dump(e.v.cond->then, pad + 1);
+            if (e.v.cond->otherwise.t != EXPR_NONE) {
+                printf(" ");
+                expr_dump(e.v.cond->otherwise, pad + 1);
+            }
+            printf(")\n");
+            break;
+        }
+
+        case EXPR_LET: {
+            Let *let = e.v.let;
+            PADDING(2*pad);
+            printf("(let (");
+            for (size_t i = 0; i < let->inits.count; ++i) {
+                expr_dump(let->inits.items[i], pad + 1);
+                if (i + 1 != let->inits.count) printf(" ");
+            }
+            printf(")\n");
+            expr_dump(let->body, pad + 1);
+            PADDING(2*pad);
+            printf(")\n");
+            break;
+        }
+
         case EXPR_FUNCALL: {
             Funcall *f = e.v.f;
             PADDING(2*pad);
             printf("(funcall\n");
 
             PADDING(3*pad);
-            printf("(name ("SV_Fmt"))\n", SV_Args(f->name));
+            printf("(name ("SV_Fmt"))\n", SV_Args(f->name->sv));
             
             PADDING(3*pad);
             printf("(args (");
@@ -5,64 +5,31 @@
 #include "lexer.h"
 #include "arena.h"
 
+// Names bound by lexical frame, used only while parsing
+typedef struct Scope {
+    struct Scope *parent;
+    Symbol **names;
+    size_t count;
+    Lambda *fn; // Not NULL for frame of lambda arguments
+} Scope;
+
 LAM_API String_View *sv_dy(Arena *a, String_View sv);
 LAM_API LObject obj_from_atom(Arena *a, Atom atom);
 
-LAM_API Funcall *funcall_new(Arena *a, String_View name);
-
-LAM_API Statement parse_statement(Arena *a, Lexer *L);
-LAM_API Funcall *parse_funcall(Arena *a, Lexer *L);
-LAM_API Expr parse_expr(Arena *a, Lexer *L);
-LAM_API Atom parse_atom(Token tk);
-
-LAM_API Expr stateval(Arena *a, Statement *s);
-LAM_API Expr statfuncall(Funcall *f);
-
-#define arethOp_cast(a, expected) \
-    do { \
-        if ((a)->t != (expected)) { \
-            (a)->t = (expected); \
-            switch ((a)->t) { \
-                case ATOM_FLT: { \
-                    (a)->v.as_flt = (double)(a)->v.as_int;\
-                    break; \
-                } \
-                case ATOM_INT: { \
-                    (a)->v.as_int = (i64)(a)->v.as_flt;\
-                    break; \
-                } \
-                default: { \
-                    report("Cannot cast to type `%u` for arethemtic op", (a)->t);\
-                    exit(1); \
-                } \
-            } \
-        } \
-    } while(0)
-
-#define integerOp(op, args, count, dest) \
-    (dest)->v.as_int = (args)[0].v.a.v.as_int; \
-    for (size_t i = 1; i < (count); ++i) { \
-        arethOp_cast(&(args)[i].v.a, ATOM_INT); \
-        (dest)->v.as_int = (dest)->v.as_int op (args)[i].v.a.v.as_int; \
-    }
-
-#define floatOp(op, args, count, dest) \
-    (dest)->v.as_flt = (args)[0].v.a.v.as_flt; \
-    for (size_t i = 1; i < (count); ++i) { \
-        arethOp_cast(&(args)[i].v.a, ATOM_FLT); \
-        (dest)->v.as_flt = (dest)->v.as_flt op (args)[i].v.a.v.as_flt; \
-    }
-
-#define arethOp(op, args, count, dest) \
-    do { \
-        if ((dest)->t == ATOM_FLT) { \
-            floatOp(op, args, count, dest) \
-        } else if ((dest)->t == ATOM_INT) { \
-            integerOp(op, args, count, dest) \
-        } else { \
-            report("Invalid type `%u` for arethmetic op", (dest)->t); \
-            (dest)->t = ATOM_NIL; \
-        } \
-    } while(0)
+LAM_API Funcall *funcall_new(Arena *a, Symbol *name);
+
+// Parser keeps nesting on its own stack, so depth of forms is limited only by memory.
+// Evaluation of calls is recursive, so it fails on nesting deeper than `EXPR_DEPTH_MAX`
+LAM_API Statement parse_statement(Interp *I, Arena *a, Lexer *L);
+LAM_API Expr parse_context(Interp *I, Arena *a, Lexer *L, Scope *sc);
+LAM_API Expr parse_expr(Interp *I, Arena *a, Lexer *L, Scope *sc);
+LAM_API Expr parse_var(Interp *I, Arena *a, Scope *sc, Symbol *name);
+LAM_API Expr expr_copy(Arena *a, Expr e); // Deep copy, doesn't recurse
+LAM_API size_t expr_count(Expr *e); // Count of nodes in tree, every expression is one node
+LAM_API Expr parse_atom(Interp *I, Arena *a, Lexer *L, Token tk);
+LAM_API Expr parse_input(Arena *a, Lexer *L, Token tk);
+
+// Failures of parsing are returned as EXPR_ERROR with place of token
+LAM_API Expr parse_error(Arena *a, Lexer *L, Token tk, const char *fmt, ...);
 
 #endif // PARSER_H_
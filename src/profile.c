@@ -0,0 +1,83 @@
+#include "profile.h"
+#include "parser.h"
+
+static const char *phase_names[PROF_COUNT] = {
+    [PROF_LEX] = "lex",
+    [PROF_PARSE] = "parse",
+    [PROF_EVAL] = "eval",
+    [PROF_PRINT] = "print",
+};
+
+// Snapshot must be taken before first token of form is peeked, so its scanning belongs to form.
+// Tokens are counted when they are consumed, lookahead which is already scanned belongs to form too
+void prof_form_begin(Profile *p, Prof_Form *f, Lexer *L, Arena *a)
+{
+    memcpy(f->ns, p->ns, sizeof(f->ns));
+    f->tokens = L->ntokens - L->ahead_count;
+    f->funcalls = atomic_load_explicit(&p->funcalls, memory_order_relaxed);
+    f->arena = arena_used(a);
+    f->start = prof_now();
+    f->first = lexer_peek(L);
+}
+
+void prof_form_parsed(Profile *p, Prof_Form *f, Statement *s)
+{
+    u64 lexed = p->ns[PROF_LEX] - f->ns[PROF_LEX];
+    p->ns[PROF_PARSE] += prof_now() - f->start - lexed;
+    if (s->t == STATEMENT_VOID) p->nodes += expr_count(&s->v.e);
+}
+
+// Arena is measured before form is dropped, so tree and result are counted
+void prof_form_end(Profile *p, Prof_Form *f, Lexer *L, Arena *a)
+{
+    size_t tokens = L->ntokens - L->ahead_count - f->tokens;
+    size_t bytes = arena_used(a) - f->arena;
+
+    p->tokens += tokens;
+    p->forms += 1;
+    p->arena_bytes += bytes;
+    if (bytes > p->arena_max) p->arena_max = bytes;
+
+    if (!p->json) return;
+
+    fprintf(p->json, "{\"file\": \"%s\", \"row\": %zu, \"col\": %zu, \"lex_ns\": %llu, \"parse_ns\": %llu, "
+            "\"eval_ns\": %llu, \"print_ns\": %llu, \"tokens\": %zu, \"funcalls\": %zu, \"arena_bytes\": %zu}\n",
+            L->file ? L->file : "", f->first.row, f->first.col,
+            p->ns[PROF_LEX] - f->ns[PROF_LEX], p->ns[PROF_PARSE] - f->ns[PROF_PARSE],
+            p->ns[PROF_EVAL] - f->ns[PROF_EVAL], p->ns[PROF_PRINT] - f->ns[PROF_PRINT],
+            tokens, atomic_load_explicit(&p->funcalls, memory_order_relaxed) - f->funcalls, bytes);
+}
+
+void prof_merge(Profile *into, Profile *from)
+{
+    for (size_t i = 0; i < PROF_COUNT; ++i) into->ns[i] += from->ns[i];
+    into->tokens += from->tokens;
+    into->nodes += from->nodes;
+    atomic_fetch_add(&into->funcalls, atomic_load(&from->funcalls));
+    into->forms += from->forms;
+    into->arena_bytes += from->arena_bytes;
+    if (from->arena_max > into->arena_max) into->arena_max = from->arena_max;
+}
+
+void prof_dump(Profile *p, FILE *out)
+{
+    u64 total = 0;
+    for (size_t i = 0; i < PROF_COUNT; ++i) total += p->ns[i];
+
+    size_t counts[PROF_COUNT] = {
+        [PROF_LEX] = p->tokens,
+        [PROF_PARSE] = p->nodes,
+        [PROF_EVAL] = atomic_load(&p->funcalls),
+        [PROF_PRINT] = p->forms,
+    };
+    const char *units[PROF_COUNT] = { "tokens", "nodes", "funcalls", "forms" };
+
+    fprintf(out, "%-8s %12s %7s %12s %-8s %10s\n", "phase", "time ms", "share", "count", "", "ns/count");
+    for (size_t i = 0; i < PROF_COUNT; ++i) {
+        fprintf(out, "%-8s %12.3lf %6.1lf%% %12zu %-8s %10.1lf\n",
+                phase_names[i], p->ns[i] / 1e6, total ? 100.0 * p->ns[i] / total : 0.0,
+                counts[i], units[i], counts[i] ? (double)p->ns[i] / counts[i] : 0.0);
+    }
+    fprintf(out, "%zu forms in %.3lf ms, arena bytes: %zu total, %zu max per form\n",
+            p->forms, total / 1e6, p->arena_bytes, p->arena_max);
+}
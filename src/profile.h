@@ -0,0 +1,83 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "types.h"
+#include "arena.h"
+#include "lexer.h"
+
+/*
+ * Timers and counters of `-p`. Lexer and interpreter refer to profile,
+ * which is NULL unless profiling, so disabled profile costs one branch
+ * per scanned token and per dispatched call of tree walker. Bytecode and closure
+ * compiled forms add their calls once per run. Everything else is counted per form.
+ * Parse time doesn't include lexing of tokens parser asked for.
+ */
+typedef enum {
+    PROF_LEX = 0,
+    PROF_PARSE,
+    PROF_EVAL,
+    PROF_PRINT,
+    PROF_COUNT
+} Prof_Phase;
+
+struct Profile {
+    u64 ns[PROF_COUNT];
+    size_t tokens;
+    size_t nodes;           // Nodes of parsed trees
+    atomic_size_t funcalls; // Calls of natives and closures, futures count it from other threads
+    size_t forms;
+    size_t arena_bytes;     // Sum of arena bytes used by forms
+    size_t arena_max;       // Max of arena bytes used by form
+    FILE *json;             // One line per form if not NULL
+};
+
+// Counters at the beginning of form, differences are written to JSON line of form
+typedef struct {
+    u64 start;
+    u64 ns[PROF_COUNT];
+    size_t tokens;
+    size_t funcalls;
+    size_t arena;
+    Token first;
+} Prof_Form;
+
+LAM_FUNC u64 prof_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Adds time since `since` to phase, returns now for next phase
+LAM_FUNC u64 prof_lap(Profile *p, Prof_Phase phase, u64 since)
+{
+    u64 t = prof_now();
+    p->ns[phase] += t - since;
+    return t;
+}
+
+LAM_FUNC void prof_funcall(Profile *p)
+{
+    atomic_fetch_add_explicit(&p->funcalls, 1, memory_order_relaxed);
+}
+
+// Compiled forms count their calls at once
+LAM_FUNC void prof_funcalls(Profile *p, size_t n)
+{
+    atomic_fetch_add_explicit(&p->funcalls, n, memory_order_relaxed);
+}
+
+LAM_API void prof_form_begin(Profile *p, Prof_Form *f, Lexer *L, Arena *a);
+LAM_API void prof_form_parsed(Profile *p, Prof_Form *f, Statement *s);
+LAM_API void prof_form_end(Profile *p, Prof_Form *f, Lexer *L, Arena *a);
+
+LAM_API void prof_merge(Profile *into, Profile *from);
+
+// Summary table of all forms
+LAM_API void prof_dump(Profile *p, FILE *out);
+
+#endif // PROFILE_H_
@@ -0,0 +1,488 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "lexer.h"
+#include "parser.h"
+#include "eval.h"
+#include "ccomp.h"
+#include "interp.h"
+
+#define SERVE_BACKLOG   128
+#define SERVE_QUEUE     1024 // Sessions with request waiting for worker
+#define SERVE_READ      4096 // Bytes read at once while size of frame is not known
+#define SERVE_SEND_SECS 10   // Client which doesn't take response for so long is dropped
+#define SERVE_RETRY_MS  100  // Pause of accepting after process ran out of descriptors
+
+// Connection with own interpreter. Session is watched by poller, waits in queue
+// or is served by one worker, so its interpreter is never used by two threads.
+// Poller collects frame in `in` without blocking, worker gets only complete one
+typedef struct {
+    int fd;
+    Interp I;
+    char *in;
+    size_t in_count;
+    size_t in_capacity;
+} Session;
+
+typedef struct {
+    Session **items;
+    size_t count;
+    size_t capacity;
+} Sessions;
+
+// Sessions with request to read. Poller waits if it's full, workers wait if it's empty
+typedef struct {
+    Session *items[SERVE_QUEUE];
+    size_t head, count;
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+    pthread_cond_t nonfull;
+} Session_Queue;
+
+// Shared by poller and workers
+typedef struct {
+    Session_Queue ready;
+    pthread_mutex_t lock; // Guards `served`
+    Sessions served;      // Given back by workers after response, poller watches them again
+    int wake[2];          // Pipe which interrupts poll when session is given back
+} Server;
+
+typedef struct {
+    char *data;
+    size_t count;
+    size_t capacity;
+} Reply;
+
+// Everything worker allocates is its own, so workers never share allocator
+typedef struct {
+    pthread_t thread;
+    Serve_Opts *opt;
+    Server *srv;
+    Arena arena;  // Memory of forms, rewound after each
+    Lexer lex;
+    Reply out;    // Payload of response
+} Worker;
+
+LAM_FUNC void sessions_append(Sessions *ss, Session *s)
+{
+    if (ss->count == ss->capacity) {
+        ss->capacity = ss->capacity ? ss->capacity * 2 : 64;
+        ss->items = realloc(ss->items, sizeof(Session*) * ss->capacity);
+        if (!ss->items) {
+            report("Cannot allocate %zu sessions", ss->capacity);
+            exit(1);
+        }
+    }
+    ss->items[ss->count++] = s;
+}
+
+LAM_FUNC void queue_push(Session_Queue *q, Session *s)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == SERVE_QUEUE) pthread_cond_wait(&q->nonfull, &q->lock);
+    q->items[(q->head + q->count) % SERVE_QUEUE] = s;
+    q->count += 1;
+    pthread_cond_signal(&q->nonempty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+LAM_FUNC Session *queue_pop(Session_Queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0) pthread_cond_wait(&q->nonempty, &q->lock);
+    Session *s = q->items[q->head];
+    q->head = (q->head + 1) % SERVE_QUEUE;
+    q->count -= 1;
+    pthread_cond_signal(&q->nonfull);
+    pthread_mutex_unlock(&q->lock);
+    return s;
+}
+
+/*
+ * Request
+ */
+
+// Length of payload of first frame, if its header came
+LAM_FUNC int session_header(Session *s, u32 *n)
+{
+    u32 len;
+    if (s->in_count < sizeof(len)) return 0;
+    memcpy(&len, s->in, sizeof(len));
+    *n = ntohl(len);
+    return 1;
+}
+
+LAM_FUNC int session_ready(Session *s)
+{
+    u32 n;
+    return session_header(s, &n) && s->in_count - sizeof(n) >= n;
+}
+
+// Reads what client has sent until first frame is complete, never blocks.
+// Returns 0 if connection is closed, failed or frame is too long
+LAM_FUNC int session_read(Session *s)
+{
+    while (!session_ready(s)) {
+        u32 n;
+        size_t want = SERVE_READ;
+        if (session_header(s, &n)) {
+            if (n > FRAME_MAX) return 0;
+            want = sizeof(n) + n - s->in_count;
+        }
+
+        if (s->in_count + want > s->in_capacity) {
+            char *grown = realloc(s->in, s->in_count + want);
+            if (!grown) return 0;
+            s->in = grown;
+            s->in_capacity = s->in_count + want;
+        }
+
+        ssize_t r = recv(s->fd, s->in + s->in_count, s->in_capacity - s->in_count, MSG_DONTWAIT);
+        if (r > 0) {
+            s->in_count += r;
+        } else if (r < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    return 1;
+}
+
+// Drops served frame, pipelined requests after it are kept
+LAM_FUNC void session_consume(Session *s, size_t n)
+{
+    memmove(s->in, s->in + n, s->in_count - n);
+    s->in_count -= n;
+}
+
+/*
+ * Response
+ */
+
+LAM_FUNC void reply_reserve(Reply *r, size_t n)
+{
+    if (r->count + n <= r->capacity) return;
+    size_t capacity = r->capacity ? r->capacity : 256;
+    while (capacity < r->count + n) capacity *= 2;
+
+    r->data = realloc(r->data, capacity);
+    if (!r->data) {
+        report("Cannot allocate %zu bytes for response", capacity);
+        exit(1);
+    }
+    r->capacity = capacity;
+}
+
+static void reply_printf(Reply *r, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (n <= 0) return;
+
+    reply_reserve(r, n + 1);
+    va_start(args, fmt);
+    vsnprintf(r->data + r->count, n + 1, fmt, args);
+    va_end(args);
+    r->count += n;
+}
+
+// Same format as errors of parser, but without file
+LAM_FUNC void reply_error(Reply *r, Error *err)
+{
+    reply_printf(r, "%zu:%zu: error: "SV_Fmt"\n", err->row, err->col, SV_Args(err->msg));
+}
+
+// Same format as values printed by REPL
+LAM_FUNC void reply_obj(Reply *r, LObject o)
+{
+    switch (obj_type(o)) {
+        case OBJ_TYPE_NIL: reply_printf(r, "nil\n"); break;
+        case OBJ_TYPE_INT: reply_printf(r, "%lli\n", obj_as_int(o)); break;
+        case OBJ_TYPE_FLT: reply_printf(r, "%lf\n", obj_as_flt(o)); break;
+        case OBJ_TYPE_BOOLEAN: reply_printf(r, "%s\n", obj_as_bool(o) ? "True" : "False"); break;
+        case OBJ_TYPE_STR: reply_printf(r, SV_Fmt"\n", SV_Args(*obj_as_str(o))); break;
+        case OBJ_TYPE_FUNC: reply_printf(r, "<lambda/%u>\n", obj_as_func(o)->fn->arity); break;
+        default: reply_printf(r, "<unknown>\n"); break;
+    }
+}
+
+/*
+ * Workers
+ */
+
+// Evaluates every form of request into response. Returns status of response
+LAM_FUNC int serve_request(Worker *w, Interp *I, String_View src)
+{
+    int status = SERVE_OK;
+    Arena_Mark mark = arena_mark(&w->arena);
+    w->lex = lexer_new(NULL, src);
+
+    while (lexer_peek(&w->lex).type != TK_NONE) {
+        Statement s = parse_statement(I, &w->arena, &w->lex);
+
+        if (s.t == STATEMENT_ERROR) {
+            reply_error(&w->out, s.v.err);
+            status = SERVE_ERR;
+        } else {
+            LObject o = w->opt->ccomp ? ccomp_run(I, &w->arena, ccomp_statement(I, &w->arena, &s), INPUTS_NONE)
+                                      : stateval(I, &w->arena, &s);
+            if (obj_is_none(o)) {
+                Error *err = obj_as_error(o);
+                if (err) reply_error(&w->out, err);
+                else reply_printf(&w->out, "error: evaluation failed\n");
+                status = SERVE_ERR;
+            } else {
+                reply_obj(&w->out, o);
+            }
+        }
+
+        arena_rewind(&w->arena, mark);
+    }
+
+    return status;
+}
+
+// Evaluates complete request of session and writes its response.
+// Returns 0 if response cannot be sent
+LAM_FUNC int serve_frame(Worker *w, Session *s)
+{
+    u32 n = 0;
+    session_header(s, &n); // Poller queues only sessions with complete frame
+
+    w->out.count = 0;
+    reply_reserve(&w->out, 1);
+    w->out.count = 1;
+
+    w->out.data[0] = serve_request(w, &s->I, sv_from_parts(s->in + sizeof(n), n));
+    session_consume(s, sizeof(n) + n);
+    return frame_write(s->fd, w->out.data, w->out.count);
+}
+
+// Pipe is not blocking, if it's full poller is going to wake anyway
+LAM_FUNC void serve_give_back(Server *srv, Session *s)
+{
+    pthread_mutex_lock(&srv->lock);
+    sessions_append(&srv->served, s);
+    pthread_mutex_unlock(&srv->lock);
+
+    char b = 0;
+    if (write(srv->wake[1], &b, 1) < 0) {}
+}
+
+LAM_FUNC void session_close(Session *s)
+{
+    interp_free(&s->I);
+    close(s->fd);
+    free(s->in);
+    free(s);
+}
+
+// Worker takes one request at a time, so idle connections don't hold it.
+// Workers already use every CPU, so futures of session run on worker that serves it
+static void *worker_run(void *arg)
+{
+    Worker *w = arg;
+    for (;;) {
+        Session *s = queue_pop(&w->srv->ready);
+        if (serve_frame(w, s)) serve_give_back(w->srv, s);
+        else session_close(s);
+    }
+    return NULL;
+}
+
+/*
+ * Poller
+ */
+
+LAM_FUNC int serve_listen(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        report("Path of socket `%s` is too long", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        report("Cannot create socket: %s", strerror(errno));
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SERVE_BACKLOG) < 0) {
+        report("Cannot listen on `%s`: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Entries of poll grow with watched sessions, first two of them are not sessions
+LAM_FUNC void serve_watch(struct pollfd **fds, Sessions *watched, Session *s)
+{
+    size_t capacity = watched->capacity;
+    sessions_append(watched, s);
+    if (watched->capacity != capacity) {
+        *fds = realloc(*fds, sizeof(struct pollfd) * (watched->capacity + 2));
+        if (!*fds) {
+            report("Cannot allocate %zu sessions", watched->capacity);
+            exit(1);
+        }
+    }
+    (*fds)[watched->count + 1] = (struct pollfd) { .fd = s->fd, .events = POLLIN };
+}
+
+// Session with pipelined request goes to workers again, others are watched
+LAM_FUNC void serve_next(Server *srv, struct pollfd **fds, Sessions *watched, Session *s)
+{
+    if (session_ready(s)) queue_push(&srv->ready, s);
+    else serve_watch(fds, watched, s);
+}
+
+// Client takes response for limited time, so slow reader doesn't hold worker either
+LAM_FUNC Session *session_new(Serve_Opts *opt, int fd)
+{
+    Session *s = calloc(1, sizeof(Session));
+    if (!s) {
+        report("Cannot allocate session");
+        close(fd);
+        return NULL;
+    }
+
+    struct timeval send_timeout = { .tv_sec = SERVE_SEND_SECS };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+    s->fd = fd;
+    s->I = (Interp) { .fsum = opt->fsum, .threads = 1 };
+    return s;
+}
+
+// Runs until poll fails. Closed clients must not kill server, so SIGPIPE is ignored.
+// One thread polls listening socket and idle sessions: new connections become sessions,
+// bytes of requests are collected by it, session with complete request goes to queue
+// of workers and is watched again after response
+int serve(Serve_Opts *opt)
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!opt->workers) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        opt->workers = cpus > 0 ? (size_t)cpus : 1;
+    }
+
+    int lfd = serve_listen(opt->path);
+    if (lfd < 0) return 0;
+
+    Server srv = {0};
+    if (pipe(srv.wake) < 0) {
+        report("Cannot create pipe: %s", strerror(errno));
+        close(lfd);
+        return 0;
+    }
+    fcntl(srv.wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(srv.wake[1], F_SETFL, O_NONBLOCK);
+    pthread_mutex_init(&srv.lock, NULL);
+    pthread_mutex_init(&srv.ready.lock, NULL);
+    pthread_cond_init(&srv.ready.nonempty, NULL);
+    pthread_cond_init(&srv.ready.nonfull, NULL);
+
+    Worker *workers = calloc(opt->workers, sizeof(Worker));
+    for (size_t i = 0; i < opt->workers; ++i) {
+        workers[i].opt = opt;
+        workers[i].srv = &srv;
+        if (pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]) != 0) {
+            report("Cannot start worker %zu", i);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "Serving on %s with %zu workers\n", opt->path, opt->workers);
+
+    // First two are listening socket and pipe, then one for every watched session
+    Sessions watched = {0}, served = {0};
+    struct pollfd *fds = calloc(2, sizeof(struct pollfd));
+    fds[0] = (struct pollfd) { .fd = lfd, .events = POLLIN };
+    fds[1] = (struct pollfd) { .fd = srv.wake[0], .events = POLLIN };
+    int starved = 0; // Out of descriptors, reported once until accept succeeds
+
+    for (;;) {
+        // Accepting is paused while there are no descriptors, then retried
+        int timeout = fds[0].events ? -1 : SERVE_RETRY_MS;
+        int polled = poll(fds, watched.count + 2, timeout);
+        fds[0].events = POLLIN;
+        if (polled < 0) {
+            if (errno == EINTR) continue;
+            report("Cannot poll connections: %s", strerror(errno));
+            break;
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < watched.count; ++i) {
+            Session *s = watched.items[i];
+            if (fds[i + 2].revents) {
+                if (!session_read(s)) {
+                    session_close(s);
+                    continue;
+                }
+                if (session_ready(s)) {
+                    queue_push(&srv.ready, s);
+                    continue;
+                }
+            }
+            watched.items[kept] = s;
+            fds[kept + 2] = fds[i + 2];
+            kept += 1;
+        }
+        watched.count = kept;
+
+        if (fds[1].revents) {
+            char buf[256];
+            while (read(srv.wake[0], buf, sizeof(buf)) > 0) {}
+
+            pthread_mutex_lock(&srv.lock);
+            Sessions back = srv.served;
+            srv.served = served;
+            pthread_mutex_unlock(&srv.lock);
+
+            for (size_t i = 0; i < back.count; ++i) serve_next(&srv, &fds, &watched, back.items[i]);
+            served = back;
+            served.count = 0;
+        }
+
+        if (fds[0].revents) {
+            int fd = accept(lfd, NULL, NULL);
+            if (fd < 0) {
+                int e = errno;
+                if (e == EINTR || e == ECONNABORTED || e == EAGAIN) continue;
+                if (e == EMFILE || e == ENFILE || e == ENOBUFS || e == ENOMEM) {
+                    if (!starved) report("Cannot accept connection: %s", strerror(e));
+                    starved = 1;
+                    fds[0].events = 0;
+                } else {
+                    report("Cannot accept connection: %s", strerror(e));
+                }
+                continue;
+            }
+            starved = 0;
+
+            Session *s = session_new(opt, fd);
+            if (s) serve_watch(&fds, &watched, s);
+        }
+    }
+
+    close(lfd);
+    unlink(opt->path);
+    return 0;
+}
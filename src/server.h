@@ -0,0 +1,103 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+
+#include "types.h"
+#include "arith.h"
+
+/*
+ * Evaluation service over Unix domain socket.
+ * Every frame is 4-byte length in network order followed by payload.
+ * Payload of request is source, every form of it is evaluated.
+ * Payload of response is status byte and output: value or error of every form, one per line.
+ * Errors of parser and evaluator are both `row:col: error: message`.
+ *
+ * Connection is a session with own interpreter, so its globals live until it's closed.
+ * Idle connections are polled by one thread, which also collects requests without blocking.
+ * Complete request of session is evaluated by any worker of fixed pool,
+ * so any count of connections, even slow ones, is served by `workers` threads.
+ * Requests of one connection are evaluated in order, one at a time.
+ */
+#define FRAME_MAX (16u << 20) // Longer frame closes connection
+
+enum {
+    SERVE_OK = 0,
+    SERVE_ERR,    // Some form cannot be parsed or evaluated
+};
+
+typedef struct {
+    const char *path; // Path of socket, existing file is replaced
+    size_t workers;   // Count of threads, count of CPUs if 0
+    Fsum_Mode fsum;
+    int ccomp;        // Evaluate through closure compiled tree
+} Serve_Opts;
+
+LAM_API int serve(Serve_Opts *opt);
+
+/*
+ * Framing, shared with clients
+ */
+
+// Returns 0 if connection is closed or failed before all `n` bytes
+LAM_FUNC int fd_read_all(int fd, void *buf, size_t n)
+{
+    char *p = buf;
+    while (n > 0) {
+        ssize_t r = read(fd, p, n);
+        if (r <= 0) return 0;
+        p += r;
+        n -= r;
+    }
+    return 1;
+}
+
+LAM_FUNC int fd_write_all(int fd, const void *buf, size_t n)
+{
+    const char *p = buf;
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w <= 0) return 0;
+        p += w;
+        n -= w;
+    }
+    return 1;
+}
+
+// Header and payload are sent by one call, unless socket takes only part of them
+LAM_FUNC int frame_write(int fd, const void *data, u32 n)
+{
+    u32 len = htonl(n);
+    struct iovec iov[2] = { { &len, sizeof(len) }, { (void*)data, n } };
+
+    ssize_t w = writev(fd, iov, 2);
+    if (w < 0) return 0;
+    if ((size_t)w < sizeof(len))
+        return fd_write_all(fd, (char*)&len + w, sizeof(len) - w) && fd_write_all(fd, data, n);
+
+    w -= sizeof(len);
+    return fd_write_all(fd, (const char*)data + w, n - w);
+}
+
+// Buffer grows to fit payload and is reused between frames
+LAM_FUNC int frame_read(int fd, char **buf, size_t *capacity, u32 *n)
+{
+    u32 len;
+    if (!fd_read_all(fd, &len, sizeof(len))) return 0;
+
+    *n = ntohl(len);
+    if (*n > FRAME_MAX) return 0;
+
+    if (*n > *capacity) {
+        char *grown = realloc(*buf, *n);
+        if (!grown) return 0;
+        *buf = grown;
+        *capacity = *n;
+    }
+
+    return fd_read_all(fd, *buf, *n);
+}
+
+#endif // SERVER_H_
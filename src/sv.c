@@ -1,4 +1,10 @@
 #include "sv.h"
+#include "types.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 String_View sv_from_parts(char *data, size_t count)
 {
@@ -78,14 +84,14 @@ int sv_cmp(String_View sv1, String_View sv2)
         return 0;
 }
 
-int sv_to_int(String_View sv)
+long long sv_to_int(String_View sv)
 {
-    int result = 0;
+    unsigned long long result = 0;
     for (size_t i = 0; i < sv.count && isdigit(sv.data[i]); ++i) {
         result = result * 10 + sv.data[i] - '0'; 
     }
     
-    return result;
+    return (long long)result;
 }
 
 int sv_is_float(String_View sv)
@@ -238,21 +244,23 @@ int sv_in_sv(String_View sv1, String_View sv2)
     return 0;
 }
 
-double sv_to_flt(String_View sv)
+// Whole sv must be a number, returns 0 otherwise.
+// Short numbers are terminated in stack buffer for strtod
+int sv_to_flt(String_View sv, double *out)
 {
-    char *float_cstr = malloc(sizeof(char) * sv.count + 1);
-    char *endptr = float_cstr; 
-    memcpy(float_cstr, sv.data, sv.count);
+    char buf[64];
+    char *cstr = sv.count < sizeof(buf) ? buf : malloc(sv.count + 1);
+    if (!cstr) return 0;
 
-    double d = strtod(float_cstr, &float_cstr);
+    memcpy(cstr, sv.data, sv.count);
+    cstr[sv.count] = '\0';
 
-    if (d == 0 && endptr == float_cstr) {
-        fprintf(stderr, "error: cannot convert `%s` to float64 (double)\n", float_cstr);
-        exit(1);
-    }
-    
-    free(endptr);
-    return d;
+    char *end = cstr;
+    *out = strtod(cstr, &end);
+    int ok = sv.count > 0 && end == cstr + sv.count;
+
+    if (cstr != buf) free(cstr);
+    return ok;
 }
 
 // return null terminated c-string
@@ -318,3 +326,46 @@ String_View sv_read_file(const char *file_path, char *mode)
         .data = buf
     };
 }
+
+// Maps file read-only into memory. Returns empty sv with NULL data on error.
+// Mapped sv must be released by `sv_unmap_file`
+String_View sv_map_file(const char *file_path)
+{
+    String_View result = {0};
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(report_stream(), "error: cannot open file by `%s` path: %s\n", file_path, strerror(errno));
+        return result;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(report_stream(), "error: cannot read from `%s` file: %s\n", file_path, strerror(errno));
+        goto defer;
+    }
+
+    if (st.st_size == 0) {
+        result.data = "";
+        goto defer;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(report_stream(), "error: cannot map `%s` file: %s\n", file_path, strerror(errno));
+        goto defer;
+    }
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    result.data = data;
+    result.count = st.st_size;
+
+defer:
+    close(fd);
+    return result;
+}
+
+void sv_unmap_file(String_View sv)
+{
+    if (sv.count > 0) munmap(sv.data, sv.count);
+}
@@ -27,8 +27,8 @@ String_View sv_trim_right(String_View sv);
 String_View sv_trim(String_View sv);
 String_View sv_div_by_delim(String_View *sv, char delim);
 
-int sv_to_int(String_View sv);
-double sv_to_flt(String_View sv);
+long long sv_to_int(String_View sv);
+int sv_to_flt(String_View sv, double *out);
 char *sv_to_cstr(String_View sv);
 int char_in_sv(String_View sv, char c);
 int sv_in_sv(String_View sv1, String_View sv2);
@@ -46,5 +46,7 @@ String_View sv_cut_value(String_View *sv);
 String_View sv_cut_txt(String_View *sv);
 
 String_View sv_read_file(const char *file_path, char *mode);
+String_View sv_map_file(const char *file_path);
+void sv_unmap_file(String_View sv);
 
 #endif // SV_H_
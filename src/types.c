@@ -3,12 +3,102 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+static _Thread_local FILE *report_file; // stderr if NULL
+
+FILE *report_stream(void)
+{
+    return report_file ? report_file : stderr;
+}
+
+void report_redirect(FILE *f)
+{
+    report_file = f;
+}
+
 void report(const char *fmt, ...)
 {
+    FILE *f = report_stream();
     va_list args;
     va_start(args, fmt);
-    fprintf(stderr, "REPORT. ");
-    vfprintf(stderr, fmt, args);
-    fprintf(stderr, "\n");
+    fprintf(f, "REPORT. ");
+    vfprintf(f, fmt, args);
+    fprintf(f, "\n");
     va_end(args);
 }
+
+void error_dump(Error *err)
+{
+    FILE *f = report_stream();
+    if (err->file) fprintf(f, "%s:", err->file);
+    fprintf(f, "%zu:%zu: error: "SV_Fmt"\n", err->row, err->col, SV_Args(err->msg));
+}
+
+Error *error_vformat(Arena *a, Loc at, const char *fmt, va_list args)
+{
+    Error *err = arena_alloc(a, sizeof(Error));
+    err->file = at.file;
+    err->row = at.row;
+    err->col = at.col;
+
+    va_list copy;
+    va_copy(copy, args);
+    int n = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+
+    err->msg.count = n > 0 ? (size_t)n : 0;
+    err->msg.data = arena_alloc_raw(a, err->msg.count + 1, 1);
+    vsnprintf(err->msg.data, err->msg.count + 1, fmt, args);
+    return err;
+}
+
+// Failure may outlive arena where it happened, e.g. in future
+Error *error_copy(Arena *a, Error *err)
+{
+    Error *copy = arena_alloc(a, sizeof(Error));
+    *copy = *err;
+    copy->msg.data = arena_alloc_raw(a, err->msg.count + 1, 1);
+    memcpy(copy->msg.data, err->msg.data, err->msg.count + 1);
+    return copy;
+}
+
+LObject obj_fail(Arena *a, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    Error *err = error_vformat(a, (Loc) {0}, fmt, args);
+    va_end(args);
+    return obj_error(err);
+}
+
+const char *obj_type_name(LObj_Type t)
+{
+    switch (t) {
+        case OBJ_TYPE_NIL: return "nil";
+        case OBJ_TYPE_INT: return "int";
+        case OBJ_TYPE_FLT: return "float";
+        case OBJ_TYPE_BOOLEAN: return "boolean";
+        case OBJ_TYPE_STR: return "string";
+        case OBJ_TYPE_FUNC: return "function";
+        case OBJ_TYPE_FUTURE: return "future";
+        default: return "unknown";
+    }
+}
+
+LObject obj_bigint(Arena *a, i64 i)
+{
+    i64 *box = arena_alloc_raw(a, sizeof(i64), sizeof(i64));
+    *box = i;
+    return nb_make(NB_BIGINT, (uintptr_t)box);
+}
+
+// Boxes raw value of known type
+LObject obj_box(Arena *a, LObj_Type t, LValue v)
+{
+    switch (t) {
+        case OBJ_TYPE_INT: return obj_int(a, v.i);
+        case OBJ_TYPE_FLT: return obj_flt(v.f);
+        case OBJ_TYPE_BOOLEAN: return obj_bool(v.b);
+        case OBJ_TYPE_STR: return obj_str(v.s);
+        default: return OBJ_NIL;
+    }
+}
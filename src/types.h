@@ -4,7 +4,10 @@
 #define LAM_API extern
 #define LAM_FUNC static inline
 
+#include <stdint.h>
+#include <stdarg.h>
 #include "sv.h"
+#include "arena.h"
 
 typedef unsigned long long u64;
 typedef signed long long i64;
@@ -21,10 +24,18 @@ typedef enum {
     OBJ_TYPE_INT,
     OBJ_TYPE_FLT,
     OBJ_TYPE_BOOLEAN,
-    OBJ_TYPE_STR
+    OBJ_TYPE_STR,
+    OBJ_TYPE_FUNC,
+    OBJ_TYPE_FUTURE
 } LObj_Type;
 
-// Lambda Value
+// Name of type for messages, e.g. `int`
+LAM_API const char *obj_type_name(LObj_Type t);
+
+// Ending of noun which is counted by `n`
+#define plural_s(n) ((n) == 1 ? "" : "s")
+
+// Raw value, its type is known from context
 typedef union {
     String_View *s;
     double f;
@@ -33,17 +44,95 @@ typedef union {
     int b;
 } LValue;
 
-// Lambda Object
-typedef struct {
-    LValue v;
-    u8 t;
-} LObject;
+/*
+ * Lambda Object is NaN-boxed into one word.
+ * Every float is stored as is, all NaNs are made canonical positive quiet NaN.
+ * Other objects are placed into negative quiet NaN space, that floats never use:
+ *
+ *   1111111111111 ttt pppppppppppppppppppppppppppppppppppppppppppppppp
+ *   sign+exp+qnan tag 48-bit payload
+ *
+ * Integers which don't fit 48 bits are boxed in arena (tag NB_BIGINT).
+ */
+typedef u64 LObject;
+
+#define NB_BOX       0xFFF8000000000000ull
+#define NB_QNAN      0x7FF8000000000000ull
+#define NB_PAYLOAD   0x0000FFFFFFFFFFFFull
+#define NB_TAG_SHIFT 48
+
+enum {
+    NB_NIL = 0,
+    NB_INT,
+    NB_BOOL,
+    NB_STR,
+    NB_BIGINT,
+    NB_FUNC,      // Pointer to closure
+    NB_FUTURE,    // Pointer to future, lives until end of top-level form
+    NB_NONE = 7,  // No value, evaluation failed. Payload is `Error`, if it's known why
+};
+
+#define nb_make(tag, payload) (NB_BOX | ((u64)(tag) << NB_TAG_SHIFT) | ((u64)(payload) & NB_PAYLOAD))
+
+#define OBJ_NIL  ((LObject)nb_make(NB_NIL, 0))
+#define OBJ_NONE ((LObject)nb_make(NB_NONE, 0))
+
+#define obj_is_boxed(o) (((o) & NB_BOX) == NB_BOX)
+#define obj_tag(o)      (((o) >> NB_TAG_SHIFT) & 7)
+#define obj_is_none(o)  (obj_is_boxed(o) && obj_tag(o) == NB_NONE)
+#define obj_ptr(o)      ((void*)(uintptr_t)((o) & NB_PAYLOAD))
+
+LAM_FUNC LObj_Type obj_type(LObject o)
+{
+    if (!obj_is_boxed(o)) return OBJ_TYPE_FLT;
+    switch (obj_tag(o)) {
+        case NB_INT:
+        case NB_BIGINT: return OBJ_TYPE_INT;
+        case NB_BOOL: return OBJ_TYPE_BOOLEAN;
+        case NB_STR: return OBJ_TYPE_STR;
+        case NB_FUNC: return OBJ_TYPE_FUNC;
+        case NB_FUTURE: return OBJ_TYPE_FUTURE;
+        default: return OBJ_TYPE_NIL;
+    }
+}
+
+LAM_FUNC LObject obj_flt(double f)
+{
+    LObject o;
+    if (f != f) return NB_QNAN;
+    memcpy(&o, &f, sizeof(o));
+    return o;
+}
 
-#define OBJ_NIL (LObject) { .t = OBJ_TYPE_NIL }
-#define OBJ_FLT(val) (LObject) { .t = OBJ_TYPE_FLT, .v = (LValue) { .f = (val) } }
-#define OBJ_INT(val) (LObject) { .t = OBJ_TYPE_INT, .v = (LValue) { .i = (val) } }
-#define OBJ_BOOL(val) (LObject) { .t = OBJ_TYPE_BOOLEAN, .v = (LValue) { .b = (val) } }
-#define OBJ_STR(val) (LObject) { .t = OBJ_TYPE_STR, .v = (LValue) { .s = (val)}}
+LAM_FUNC double obj_as_flt(LObject o)
+{
+    double f;
+    memcpy(&f, &o, sizeof(f));
+    return f;
+}
+
+LAM_FUNC i64 obj_as_int(LObject o)
+{
+    if (obj_tag(o) == NB_BIGINT) return *(i64*)obj_ptr(o);
+    return (i64)(o << 16) >> 16;
+}
+
+#define obj_bool(b)      ((LObject)nb_make(NB_BOOL, (b) != 0))
+#define obj_as_bool(o)   ((int)((o) & 1))
+#define obj_str(sv)      ((LObject)nb_make(NB_STR, (uintptr_t)(sv)))
+#define obj_as_str(o)    ((String_View*)obj_ptr(o))
+#define obj_func(c)      ((LObject)nb_make(NB_FUNC, (uintptr_t)(c)))
+#define obj_as_func(o)   ((Closure*)obj_ptr(o))
+#define obj_future(f)    ((LObject)nb_make(NB_FUTURE, (uintptr_t)(f)))
+#define obj_as_future(o) ((Future*)obj_ptr(o))
+#define obj_error(err)   ((LObject)nb_make(NB_NONE, (uintptr_t)(err)))
+#define obj_as_error(o)  (obj_is_none(o) ? (Error*)obj_ptr(o) : NULL) // NULL for OBJ_NONE and values
+
+// Only nil and false are false
+#define obj_is_true(o)   ((o) != OBJ_NIL && (o) != obj_bool(0))
+
+// Objects which refer to memory of arena, failure refers to its error
+#define obj_is_ref(o)    (obj_is_boxed(o) && obj_tag(o) >= NB_STR)
 
 typedef enum {
     ATOM_NIL = 0,
@@ -52,10 +141,16 @@ typedef enum {
     ATOM_STR,
 } Atom_Type;
 
+// Interned string. Equal strings are the same symbol, so compares by pointer
+typedef struct {
+    String_View sv; // Null terminated. First member, so symbol is valid string object
+    u64 hash;
+} Symbol;
+
 typedef union {
     i64 as_int;
     double as_flt;
-    String_View as_str;
+    Symbol *as_str;
 } Atom_Value;
 
 typedef struct {
@@ -64,16 +159,63 @@ typedef struct {
 } Atom;
 
 typedef struct Funcall Funcall;
+typedef struct Native Native;
+typedef struct Global Global;
+typedef struct Let Let;
+typedef struct Define Define;
+typedef struct Lambda Lambda;
+typedef struct If If;
+typedef struct Closure Closure;
+typedef struct Interp Interp;
+typedef struct Future Future;
+typedef struct Pool Pool;
+typedef struct Profile Profile;
+
+// Place of token in source
+typedef struct {
+    const char *file; // NULL if source is not a file
+    u32 row, col;     // Row is 0 if place is not known
+} Loc;
+
+// Failure with place in source. Allocated only when something fails
+typedef struct {
+    const char *file; // NULL if source is not a file
+    size_t row, col;  // Row is 0 until failure reaches node with place
+    String_View msg;
+} Error;
 
 typedef enum {
     EXPR_NONE = 0,
     EXPR_ATOM,
     EXPR_FUNCALL,
+    EXPR_INPUT,
+    EXPR_LOCAL,
+    EXPR_GLOBAL,
+    EXPR_LET,
+    EXPR_DEFINE,
+    EXPR_LAMBDA,
+    EXPR_IF,
+    EXPR_FUTURE, // Body is closure without arguments, see `lambda`
+    EXPR_ERROR, // Parsing failed, see `err`
 } Expr_Type;
 
+// Address of lexical variable, resolved while parsing
+typedef struct {
+    u32 depth; // How many frames up from current
+    u32 slot;  // Index in frame
+} Local;
+
 typedef union {
     Atom a;
     Funcall *f;
+    size_t input; // Index of value provided for evaluation
+    Local local;
+    Global *global;
+    Let *let;
+    Define *def;
+    Lambda *lambda;
+    If *cond;
+    Error *err;
 } Expr_Value;
 
 typedef struct {
@@ -90,28 +232,105 @@ typedef struct {
 } Funargs;
 
 struct Funcall {
-    String_View name;
+    Symbol *name;
+    Native *native; // Resolved while parsing, NULL if name was unknown
+    Expr callee;    // Variable or expression of function, EXPR_NONE for native
     Funargs args;
+    Loc at;         // Name of function, or first argument for call of expression
+};
+
+// Bindings of new frame are evaluated in outer scope
+struct Let {
+    Funargs inits;
+    Expr body;
+};
+
+struct Define {
+    Global *global;
+    Expr value;
+};
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    Local *items;
+} Locals;
+
+// Frame of call holds arguments and then captured values.
+// Captures are addresses of free variables in defining scope
+struct Lambda {
+    u32 arity;
+    Locals captures;
+    Expr body;
+};
+
+struct If {
+    Expr cond;
+    Expr then;
+    Expr otherwise; // EXPR_NONE if omitted
 };
 
-#define funarg_append(a, buf, item) arena_da_append(a,  buf, item, 16)
+struct Closure {
+    Lambda *fn;
+    LObject captured[];
+};
+
+#define funarg_append(a, buf, item) arena_da_append_at(a,  buf, item, 16, "funarg_append")
 
 typedef enum {
     STATEMENT_NONE = 0,
     STATEMENT_VOID,
+    STATEMENT_ERROR,
 } Statement_Type;
 
 typedef union {
     Expr e;         // void statement respresent a single expresion
+    Error *err;     // Why statement cannot be parsed
 } Statement_Value;
 
 typedef struct {
     Statement_Type t;
     Statement_Value v;
+    Loc at;         // Beginning of form
 } Statement;
 
 #define STATE_NONE (Statement) {0}
 
 LAM_API void report(const char *fmt, ...);
+LAM_API void error_dump(Error *err);
+
+// Message is formatted into arena
+LAM_API Error *error_vformat(Arena *a, Loc at, const char *fmt, va_list args);
+LAM_API Error *error_copy(Arena *a, Error *err);
+
+// Failure of evaluation, place is given by innermost call which sees it
+__attribute__((format(printf, 2, 3)))
+LAM_API LObject obj_fail(Arena *a, const char *fmt, ...);
+
+// Failure without place gets `at`, other objects are returned as is
+LAM_FUNC LObject obj_locate(LObject o, Loc at)
+{
+    Error *err = obj_as_error(o);
+    if (err && !err->row && at.row) {
+        err->file = at.file;
+        err->row = at.row;
+        err->col = at.col;
+    }
+    return o;
+}
+
+// Reports and errors of calling thread go to `f`, NULL restores stderr
+LAM_API void report_redirect(FILE *f);
+LAM_API FILE *report_stream(void);
+
+LAM_API LObject obj_bigint(Arena *a, i64 i);
+LAM_API LObject obj_box(Arena *a, LObj_Type t, LValue v);
+
+// Integer is boxed in arena only if it doesn't fit payload
+LAM_FUNC LObject obj_int(Arena *a, i64 i)
+{
+    if (((i64)((u64)i << 16) >> 16) == i) return nb_make(NB_INT, i);
+    return obj_bigint(a, i);
+}
 
 #endif // TYPES_H_
@@ -0,0 +1,161 @@
+#include <assert.h>
+#include "vm.h"
+#include "arith.h"
+#include "interp.h"
+#include "profile.h"
+
+// Values of stack are contiguous buffer of integers or floats for kernels
+_Static_assert(sizeof(LValue) == sizeof(i64), "LValue must be single word");
+
+#define vm_reduce(field, kernel, op, ...) \
+    do { \
+        Instruction n = *ip++; \
+        sp -= n; \
+        sp[0].field = kernel(op, &sp[0].field, n, ##__VA_ARGS__); \
+        sp += 1; \
+    } while (0)
+
+LAM_FUNC Loc chunk_loc(Chunk *c, size_t pc)
+{
+    for (size_t i = 0; i < c->locs.count; ++i) {
+        if (c->locs.items[i].pc == pc) return c->locs.items[i].at;
+    }
+    return (Loc) {0};
+}
+
+// Stack is temporary, result is boxed after it's dropped
+LObject vm_run(Interp *I, Arena *a, Chunk *c)
+{
+    Arena_Mark mark = arena_mark(a);
+    LValue *stack = arena_alloc_raw(a, sizeof(LValue) * (c->stack_max + 1), sizeof(LValue));
+    LValue *sp = stack;
+    Const *k = c->consts.items;
+    Instruction *ip = c->code.items;
+    if (I->prof) prof_funcalls(I->prof, c->calls);
+
+    for (;;) {
+        switch ((Opcode)*ip++) {
+            case OP_NOP: break;
+
+            case OP_CONST: {
+                *sp++ = k[ip[0]].v;
+                ip += 1;
+                break;
+            }
+
+            case OP_CONSTW: {
+                *sp++ = k[ip[0] | ((u32)ip[1] << 16)].v;
+                ip += 2;
+                break;
+            }
+
+            case OP_I2F: sp[-1].f = (double)sp[-1].i; break;
+            case OP_F2I: sp[-1].i = (i64)sp[-1].f; break;
+
+            case OP_IADD: vm_reduce(i, arith_ireduce, ARITH_ADD); break;
+            case OP_ISUB: vm_reduce(i, arith_ireduce, ARITH_SUB); break;
+            case OP_IMUL: vm_reduce(i, arith_ireduce, ARITH_MUL); break;
+            case OP_IDIV: {
+                Instruction n = *ip++;
+                sp -= n;
+                const char *why = arith_idiv(&sp[0].i, n, &sp[0].i);
+                if (why) {
+                    arena_rewind(a, mark);
+                    return obj_locate(obj_fail(a, "%s", why), chunk_loc(c, ip - 2 - c->code.items));
+                }
+                sp += 1;
+                break;
+            }
+
+            case OP_FADD: vm_reduce(f, arith_freduce, ARITH_ADD, I->fsum); break;
+            case OP_FSUB: vm_reduce(f, arith_freduce, ARITH_SUB, I->fsum); break;
+            case OP_FMUL: vm_reduce(f, arith_freduce, ARITH_MUL, I->fsum); break;
+            case OP_FDIV: vm_reduce(f, arith_freduce, ARITH_DIV, I->fsum); break;
+
+            case OP_RET: {
+                LValue v = sp[-1];
+                arena_rewind(a, mark);
+                return obj_box(a, c->t, v);
+            }
+
+            default: {
+                assert(0 && "Unreachable opcode");
+            }
+        }
+    }
+}
+
+/*
+ * Disassembler
+ */
+
+static const char *opnames[OP_COUNT] = {
+    [OP_NOP]    = "NOP",
+    [OP_CONST]  = "CONST",
+    [OP_CONSTW] = "CONSTW",
+    [OP_I2F]    = "I2F",
+    [OP_F2I]    = "F2I",
+    [OP_IADD]   = "IADD",
+    [OP_ISUB]   = "ISUB",
+    [OP_IMUL]   = "IMUL",
+    [OP_IDIV]   = "IDIV",
+    [OP_FADD]   = "FADD",
+    [OP_FSUB]   = "FSUB",
+    [OP_FMUL]   = "FMUL",
+    [OP_FDIV]   = "FDIV",
+    [OP_RET]    = "RET",
+};
+
+LAM_FUNC void const_dump(Const k)
+{
+    switch (k.t) {
+        case OBJ_TYPE_INT: printf("%lli", k.v.i); break;
+        case OBJ_TYPE_FLT: printf("%lf", k.v.f); break;
+        case OBJ_TYPE_STR: printf("\""SV_Fmt"\"", SV_Args(*k.v.s)); break;
+        default: printf("nil"); break;
+    }
+}
+
+void chunk_disasm(Chunk *c)
+{
+    printf("; chunk: %zu words, %zu consts, stack %zu\n",
+           c->code.count, c->consts.count, c->stack_max);
+
+    size_t i = 0;
+    while (i < c->code.count) {
+        Opcode op = c->code.items[i];
+        printf("%04zu  %-8s", i, op < OP_COUNT ? opnames[op] : "???");
+
+        switch (op) {
+            case OP_CONST: {
+                Instruction idx = c->code.items[i + 1];
+                printf("%-8u; ", idx);
+                const_dump(c->consts.items[idx]);
+                i += 2;
+                break;
+            }
+
+            case OP_CONSTW: {
+                u32 idx = c->code.items[i + 1] | ((u32)c->code.items[i + 2] << 16);
+                printf("%-8u; ", idx);
+                const_dump(c->consts.items[idx]);
+                i += 3;
+                break;
+            }
+
+            case OP_IADD: case OP_ISUB: case OP_IMUL: case OP_IDIV:
+            case OP_FADD: case OP_FSUB: case OP_FMUL: case OP_FDIV: {
+                printf("%u", c->code.items[i + 1]);
+                i += 2;
+                break;
+            }
+
+            default: {
+                i += 1;
+                break;
+            }
+        }
+
+        printf("\n");
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef VM_H_
+#define VM_H_
+
+#include "types.h"
+#include "arena.h"
+
+/*
+ * Bytecode layout: every instruction is one `Instruction` word,
+ * operands (if any) follows it as separate words.
+ * Arithmetic instructions are typed, compiler inserts casts
+ * so VM never checks types of values at runtime.
+ */
+typedef enum {
+    OP_NOP = 0,
+    OP_CONST,      // [idx]        push constant
+    OP_CONSTW,     // [lo] [hi]    push constant with 32-bit index
+    OP_I2F,        //              cast top of stack to float
+    OP_F2I,        //              cast top of stack to integer
+    OP_IADD,       // [n]          reduce n integers from stack
+    OP_ISUB,       // [n]
+    OP_IMUL,       // [n]
+    OP_IDIV,       // [n]
+    OP_FADD,       // [n]          reduce n floats from stack
+    OP_FSUB,       // [n]
+    OP_FMUL,       // [n]
+    OP_FDIV,       // [n]
+    OP_RET,        //              return top of stack
+    OP_COUNT
+} Opcode;
+
+#define INST_MAX ((Instruction)~0)
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    Instruction *items;
+} Code;
+
+// Constants are raw values, type is kept only for disassembly
+typedef struct {
+    LValue v;
+    LObj_Type t;
+} Const;
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    Const *items;
+} Consts;
+
+// Place of call for instruction which may fail
+typedef struct {
+    size_t pc;
+    Loc at;
+} Code_Loc;
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    Code_Loc *items;
+} Code_Locs;
+
+// Compiled form. Lives in arena that was used for compilation
+typedef struct {
+    Code code;
+    Consts consts;
+    Code_Locs locs;   // Only division fails, so only it has place
+    LObj_Type t;      // Type of value produced by chunk
+    size_t stack_max; // Max depth of stack while running
+    size_t calls;     // Calls of source, chunk has no branches so each runs once
+} Chunk;
+
+#define code_append(a, c, inst) arena_da_append_at(a, &(c)->code, (Instruction)(inst), 64, "code_append")
+#define const_append(a, c, val) arena_da_append_at(a, &(c)->consts, val, 16, "const_append")
+#define loc_append(a, c, val)   arena_da_append_at(a, &(c)->locs, val, 16, "loc_append")
+
+typedef enum {
+    COMPILE_OK = 0,
+    COMPILE_WALK, // VM can't run form yet (variables, closures, other natives), tree walker evaluates it
+    COMPILE_FAIL, // Form fails, `error` is located the same as failure of evaluation
+} Compile_Result;
+
+LAM_API Compile_Result compile_statement(Interp *I, Arena *a, Chunk *c, Statement *s, LObject *error);
+LAM_API LObject vm_run(Interp *I, Arena *a, Chunk *c);
+LAM_API void chunk_disasm(Chunk *c);
+
+#endif // VM_H_